@@ -11,6 +11,21 @@ TARGET_STAMP:=$(TMP_DIR)/info/.files-$(SCAN_TARGET).stamp
 FILELIST:=$(TMP_DIR)/info/.files-$(SCAN_TARGET)-$(SCAN_COOKIE)
 OVERRIDELIST:=$(TMP_DIR)/info/.overrides-$(SCAN_TARGET)-$(SCAN_COOKIE)
 
+# results of the last tree scan, reused as long as no Makefile was added,
+# removed or modified since
+SCAN_SIG:=$(TMP_DIR)/info/.files-$(SCAN_TARGET).sig
+FILELIST_CACHE:=$(TMP_DIR)/info/.files-$(SCAN_TARGET).list
+OVERRIDELIST_CACHE:=$(TMP_DIR)/info/.overrides-$(SCAN_TARGET).list
+
+# dump output, indexed by the hash of the Makefile and everything it depends on,
+# plus its mtime, so touching a Makefile still forces a new dump
+SCAN_CACHE:=$(TMP_DIR)/info/cache-$(SCAN_TARGET)
+
+# Makefiles may include any of these without declaring them in SCAN_DEPS,
+# e.g. kernel-version.mk, nls.mk or cmake.mk, so all of them are part of
+# every cache key, as is the scan itself
+SCAN_KEY:=$(shell cat $(TOPDIR)/rules.mk $(TOPDIR)/include/*.mk $(TOPDIR)/include/scan.awk | $(MKHASH) md5)
+
 export ORIG_PATH:=$(if $(ORIG_PATH),$(ORIG_PATH),$(PATH))
 export PATH:=$(STAGING_DIR_HOST)/bin:$(PATH)
 
@@ -46,19 +61,31 @@ endif
 define PackageDir
   $(TMP_DIR)/.$(SCAN_TARGET): $(TMP_DIR)/info/.$(SCAN_TARGET)-$(1)
   $(TMP_DIR)/info/.$(SCAN_TARGET)-$(1): $(SCAN_DIR)/$(2)/Makefile $(foreach DEP,$(DEPS_$(SCAN_DIR)/$(2)/Makefile) $(SCAN_DEPS),$(wildcard $(if $(filter /%,$(DEP)),$(DEP),$(SCAN_DIR)/$(2)/$(DEP))))
-	{ \
-		$$(call progress,Collecting $(SCAN_NAME) info: $(SCAN_DIR)/$(2)) \
-		echo Source-Makefile: $(SCAN_DIR)/$(2)/Makefile; \
-		$(if $(3),echo Override: $(3),true); \
-		$(if $(findstring c,$(OPENWRT_VERBOSE)),$(MAKE),$(NO_TRACE_MAKE) --no-print-dir) -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) \
-			$(if $(findstring c,$(OPENWRT_VERBOSE)),,2>/dev/null) || { \
-			mkdir -p "$(TOPDIR)/logs/$(SCAN_DIR)/$(2)"; \
-			$(NO_TRACE_MAKE) --no-print-dir -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) > $(TOPDIR)/logs/$(SCAN_DIR)/$(2)/dump.txt 2>&1; \
-			$$(call progress,ERROR: please fix $(SCAN_DIR)/$(2)/Makefile - see logs/$(SCAN_DIR)/$(2)/dump.txt for details\n) \
-			rm -f $$@; \
+	KEY=$$$$({ echo '$(SCAN_KEY);$(2);$(3);$(SCAN_MAKEOPTS)'; stat -c %Y $$<; cat $$^; } | $(MKHASH) md5); \
+	if [ -f "$(SCAN_CACHE)/$$$$KEY" ]; then \
+		touch "$(SCAN_CACHE)/$$$$KEY"; \
+		cp "$(SCAN_CACHE)/$$$$KEY" $$@.tmp; \
+	else \
+		{ \
+			$$(call progress,Collecting $(SCAN_NAME) info: $(SCAN_DIR)/$(2)) \
+			echo Source-Makefile: $(SCAN_DIR)/$(2)/Makefile; \
+			$(if $(3),echo Override: $(3),true); \
+			$(if $(findstring c,$(OPENWRT_VERBOSE)),$(MAKE),$(NO_TRACE_MAKE) --no-print-dir) -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) \
+				$(if $(findstring c,$(OPENWRT_VERBOSE)),,2>/dev/null) || { \
+				mkdir -p "$(TOPDIR)/logs/$(SCAN_DIR)/$(2)"; \
+				$(NO_TRACE_MAKE) --no-print-dir -r DUMP=1 FEED="$(call feedname,$(2))" -C $(SCAN_DIR)/$(2) $(SCAN_MAKEOPTS) > $(TOPDIR)/logs/$(SCAN_DIR)/$(2)/dump.txt 2>&1; \
+				$$(call progress,ERROR: please fix $(SCAN_DIR)/$(2)/Makefile - see logs/$(SCAN_DIR)/$(2)/dump.txt for details\n) \
+				rm -f $$@; \
+				KEY=; \
+			}; \
+			echo; \
+		} > $$@.tmp; \
+		[ -z "$$$$KEY" ] || { \
+			mkdir -p $(SCAN_CACHE); \
+			cp $$@.tmp "$(SCAN_CACHE)/$$$$KEY.$$$$$$$$" && \
+			mv "$(SCAN_CACHE)/$$$$KEY.$$$$$$$$" "$(SCAN_CACHE)/$$$$KEY"; \
 		}; \
-		echo; \
-	} > $$@.tmp
+	fi
 	mv $$@.tmp $$@
 endef
 
@@ -72,11 +99,25 @@ else
   GREP_STRING=(Build/DefaultTargets|BuildPackage|KernelPackage)
 endif
 
+SCAN_FIND=find -L $(SCAN_DIR) -mindepth 1 $(if $(SCAN_DEPTH),-maxdepth $(SCAN_DEPTH)) $(SCAN_EXTRA) -name Makefile
+
 $(FILELIST): $(OVERRIDELIST)
 	rm -f $(TMP_DIR)/info/.files-$(SCAN_TARGET)-*
-	find -L $(SCAN_DIR) -mindepth 1 $(if $(SCAN_DEPTH),-maxdepth $(SCAN_DEPTH)) $(SCAN_EXTRA) -name Makefile | xargs grep -aHE 'call $(GREP_STRING)' | sed -e 's#^$(SCAN_DIR)/##' -e 's#/Makefile:.*##' | uniq | awk -v of=$(OVERRIDELIST) -f include/scan.awk > $@
+	SIG=$$({ $(SCAN_FIND) -printf '%p %s %T@\n'; cat $(TOPDIR)/include/scan.mk $(TOPDIR)/include/scan.awk; } | $(MKHASH) md5); \
+	if [ -f $(FILELIST_CACHE) -a "$$(cat $(SCAN_SIG) 2>/dev/null)" = "$$SIG" ]; then \
+		cp $(OVERRIDELIST_CACHE) $(OVERRIDELIST); \
+		cp $(FILELIST_CACHE) $@; \
+	else \
+		rm -f $(SCAN_SIG) $(TMP_DIR)/info/.files-$(SCAN_TARGET).mk; \
+		$(SCAN_FIND) | xargs grep -aHE 'call $(GREP_STRING)' | sed -e 's#^$(SCAN_DIR)/##' -e 's#/Makefile:.*##' | uniq | awk -v of=$(OVERRIDELIST) -f include/scan.awk > $@ && \
+		cp $(OVERRIDELIST) $(OVERRIDELIST_CACHE) && \
+		cp $@ $(FILELIST_CACHE) && \
+		echo "$$SIG" > $(SCAN_SIG); \
+	fi
 
+# kept when the tree scan above was served from the cache
 $(TMP_DIR)/info/.files-$(SCAN_TARGET).mk: $(FILELIST)
+	[ ! -f $@ ] || { touch $@; exit 0; }; \
 	( \
 		cat $< | awk '{print "$(SCAN_DIR)/" $$0 "/Makefile" }' | xargs grep -HE '^ *SCAN_DEPS *= *' | awk -F: '{ gsub(/^.*DEPS *= */, "", $$2); print "DEPS_" $$1 "=" $$2 }'; \
 		awk -F/ -v deps="$$DEPS" -v of="$(OVERRIDELIST)" ' \
@@ -95,7 +136,7 @@ $(TMP_DIR)/info/.files-$(SCAN_TARGET).mk: $(FILELIST)
 			print "$$(eval $$(call PackageDir," info "," dir "," pkg "))"; \
 		} ' < $<; \
 		true; \
-	) > $@.tmp
+	) > $@.tmp; \
 	mv $@.tmp $@
 
 -include $(TMP_DIR)/info/.files-$(SCAN_TARGET).mk
@@ -114,9 +155,9 @@ $(TARGET_STAMP)::
 $(TMP_DIR)/.$(SCAN_TARGET): $(TARGET_STAMP)
 	$(call progress,Collecting $(SCAN_NAME) info: merging...)
 	-cat $(FILELIST) | awk '{gsub(/\//, "_", $$0);print "$(TMP_DIR)/info/.$(SCAN_TARGET)-" $$0}' | xargs cat > $@ 2>/dev/null
+	-find $(SCAN_CACHE) -type f -mtime +30 -delete 2>/dev/null
 	$(call progress,Collecting $(SCAN_NAME) info: done)
 	echo
 
 FORCE:
 .PHONY: FORCE
-.NOTPARALLEL:
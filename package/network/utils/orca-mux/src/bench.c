@@ -0,0 +1,183 @@
+/*
+ * orca-mux-bench - CPU cost of the orca-mux export mode compression
+ *
+ * Copyright (C) 2024 SupraCoNeX <supraconex@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Runs on the AP against a capture of its own plain text event stream, e.g.
+ * with option listen set to '127.0.0.1:21059':
+ *
+ *   nc 127.0.0.1 21059 > /tmp/events    (stop after a while)
+ *   orca-mux-bench -b 64 /tmp/events
+ *
+ * The capture is cut into frames at line boundaries like export mode does
+ * and every frame is compressed with LZ4. The best CPU time of a number of
+ * runs is reported per MB of events and per frame, together with the ratio.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lz4.h>
+
+#include "orca-mux.h"
+
+struct bench_stats {
+	unsigned long frames;
+	unsigned long long raw_bytes;
+	unsigned long long lz4_bytes;
+	double cpu_time;
+};
+
+static double
+cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *
+read_capture(const char *name, size_t *len)
+{
+	char *buf = NULL, *tmp;
+	size_t size = 0;
+	FILE *f;
+
+	f = fopen(name, "r");
+	if (!f)
+		return NULL;
+
+	*len = 0;
+	do {
+		if (*len == size) {
+			size += 1024 * 1024;
+			tmp = realloc(buf, size);
+			if (!tmp) {
+				free(buf);
+				buf = NULL;
+				break;
+			}
+			buf = tmp;
+		}
+		*len += fread(buf + *len, 1, size - *len, f);
+	} while (*len == size);
+
+	fclose(f);
+	return buf;
+}
+
+static void
+bench_run(struct bench_stats *st, const char *data, size_t len,
+	  unsigned int batch_size, char *frame, int frame_size)
+{
+	const char *nl;
+	double start;
+	int cur, out;
+
+	memset(st, 0, sizeof(*st));
+	start = cpu_time();
+
+	while (len > 0) {
+		cur = len < batch_size ? len : batch_size;
+		nl = memrchr(data, '\n', cur);
+		if (nl)
+			cur = nl + 1 - data;
+
+		/* incompressible frames are sent as is */
+		out = LZ4_compress_default(data, frame, cur, frame_size);
+		if (out <= 0 || out >= cur)
+			out = cur;
+
+		st->frames++;
+		st->raw_bytes += cur;
+		st->lz4_bytes += out;
+		data += cur;
+		len -= cur;
+	}
+
+	st->cpu_time = cpu_time() - start;
+}
+
+static int
+usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [options] <capture>\n"
+		"Options:\n"
+		"  -b <kbytes>   Uncompressed bytes per frame (default: %d)\n"
+		"  -r <runs>     Number of runs, the fastest one is reported (default: 10)\n"
+		"\n", progname, ORCA_EXPORT_BATCH / 1024);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_stats st, best = {};
+	unsigned int batch_size = ORCA_EXPORT_BATCH;
+	int runs = 10, frame_size, ch, i;
+	char *data, *frame;
+	size_t len;
+
+	while ((ch = getopt(argc, argv, "b:r:")) != -1) {
+		switch (ch) {
+		case 'b':
+			batch_size = strtoul(optarg, NULL, 0) * 1024;
+			break;
+		case 'r':
+			runs = atoi(optarg);
+			break;
+		default:
+			return usage(argv[0]);
+		}
+	}
+
+	if (optind + 1 != argc || !batch_size ||
+	    batch_size > ORCA_EXPORT_BATCH_MAX || runs < 1)
+		return usage(argv[0]);
+
+	data = read_capture(argv[optind], &len);
+	if (!data) {
+		fprintf(stderr, "failed to read %s\n", argv[optind]);
+		return 1;
+	}
+
+	frame_size = LZ4_compressBound(batch_size);
+	frame = malloc(frame_size);
+	if (!frame) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for (i = 0; i < runs; i++) {
+		bench_run(&st, data, len, batch_size, frame, frame_size);
+		if (!i || st.cpu_time < best.cpu_time)
+			best = st;
+	}
+
+	printf("frames:      %lu of %u bytes\n", best.frames, batch_size);
+	printf("raw bytes:   %llu\n", best.raw_bytes);
+	printf("lz4 bytes:   %llu\n", best.lz4_bytes);
+	if (best.lz4_bytes)
+		printf("ratio:       %.2f\n",
+		       (double)best.raw_bytes / best.lz4_bytes);
+	printf("cpu time:    %.3f s\n", best.cpu_time);
+	if (best.frames && best.cpu_time > 0)
+		printf("cpu cost:    %.1f ms/MB, %.1f us/frame\n",
+		       best.cpu_time * 1e3 / (best.raw_bytes / 1e6),
+		       best.cpu_time * 1e6 / best.frames);
+
+	free(frame);
+	free(data);
+	return 0;
+}
@@ -0,0 +1,397 @@
+/*
+ * orca-mux - ORCA event multiplexer
+ *
+ * Copyright (C) 2024 SupraCoNeX <supraconex@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libubox/ulog.h>
+
+#include "orca-mux.h"
+
+LIST_HEAD(clients);
+
+/* scratch buffer for assembling the filtered output of one client */
+static char *out_buf;
+static size_t out_size;
+
+static bool
+client_reserve(size_t len)
+{
+	char *buf;
+
+	if (len <= out_size)
+		return true;
+
+	buf = realloc(out_buf, len);
+	if (!buf)
+		return false;
+
+	out_buf = buf;
+	out_size = len;
+	return true;
+}
+
+static void
+client_free(struct orca_client *cl)
+{
+	ULOG_INFO("client %p disconnected\n", cl);
+
+	orca_export_free(cl);
+	ustream_free(&cl->sfd.stream);
+	close(cl->sfd.fd.fd);
+	list_del(&cl->list);
+	free(cl);
+}
+
+static void
+client_notify_state(struct ustream *s)
+{
+	struct orca_client *cl = container_of(s, struct orca_client, sfd.stream);
+
+	if (!s->eof && !s->write_error)
+		return;
+
+	client_free(cl);
+}
+
+/* events of a batch get dropped once too much output is queued for the client */
+static void
+client_write(struct orca_client *cl, const char *data, int len, int n_events)
+{
+	struct ustream *s = &cl->sfd.stream;
+
+	if (cl->export) {
+		orca_export_write(cl, data, len);
+		return;
+	}
+
+	if (n_events && s->w.data_bytes + len > max_pending) {
+		cl->dropped += n_events;
+		return;
+	}
+
+	if (cl->dropped) {
+		ustream_printf(s, "#dropped;%lu\n", cl->dropped);
+		cl->dropped = 0;
+	}
+
+	ustream_write(s, data, len, false);
+}
+
+static void
+client_vprintf(struct orca_client *cl, const char *fmt, va_list ap)
+{
+	char buf[512], *data = buf;
+	va_list ap2;
+	int len;
+
+	va_copy(ap2, ap);
+	len = vsnprintf(buf, sizeof(buf), fmt, ap);
+
+	/* long lines, e.g. from #read, are never truncated */
+	if (len >= sizeof(buf)) {
+		if (client_reserve(len + 1)) {
+			data = out_buf;
+			vsnprintf(data, len + 1, fmt, ap2);
+		} else {
+			len = -1;
+		}
+	}
+	va_end(ap2);
+
+	if (len < 0)
+		return;
+
+	client_write(cl, data, len, 0);
+}
+
+void orca_client_printf(struct orca_client *cl, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	client_vprintf(cl, fmt, ap);
+	va_end(ap);
+}
+
+static uint32_t
+client_parse_phys(char *str)
+{
+	struct orca_phy *phy;
+	uint32_t mask = 0;
+	char *cur;
+
+	if (!strcmp(str, "*"))
+		return ~0U;
+
+	while ((cur = strsep(&str, ",")) != NULL) {
+		phy = orca_phy_get(cur);
+		if (phy)
+			mask |= 1U << phy->idx;
+	}
+
+	return mask;
+}
+
+static uint32_t
+client_parse_events(char *str)
+{
+	uint32_t mask = 0;
+	char *cur;
+	int i;
+
+	if (!strcmp(str, "*"))
+		return ORCA_EV_ALL;
+
+	while ((cur = strsep(&str, ",")) != NULL) {
+		for (i = 0; i < __ORCA_EV_MAX; i++) {
+			if (!strcmp(cur, orca_event_names[i])) {
+				mask |= 1U << i;
+				break;
+			}
+		}
+	}
+
+	return mask;
+}
+
+static void
+client_cmd_filter(struct orca_client *cl, char *args)
+{
+	char *phys = strsep(&args, ";");
+
+	if (!phys || !args) {
+		orca_client_printf(cl, "#error;filter;missing argument\n");
+		return;
+	}
+
+	cl->phy_mask = client_parse_phys(phys);
+	cl->ev_mask = client_parse_events(args);
+}
+
+static void
+client_cmd_phys(struct orca_client *cl)
+{
+	struct orca_phy *phy;
+
+	orca_client_printf(cl, "#phys");
+	list_for_each_entry(phy, &phys, list)
+		orca_client_printf(cl, ";%s", phy->name);
+	orca_client_printf(cl, "\n");
+}
+
+static void
+client_cmd_read(struct orca_client *cl, char *args)
+{
+	struct orca_phy *phy;
+	const char *file;
+	char *name = strsep(&args, ";");
+	int ret;
+
+	phy = name ? orca_phy_get(name) : NULL;
+	if (!phy || !args) {
+		orca_client_printf(cl, "#error;read;unknown phy\n");
+		return;
+	}
+
+	if (!strcmp(args, "info"))
+		file = "api_info";
+	else if (!strcmp(args, "phy"))
+		file = "api_phy";
+	else {
+		orca_client_printf(cl, "#error;read;unknown file\n");
+		return;
+	}
+
+	ret = orca_phy_read_file(phy, file, cl);
+	if (ret)
+		orca_client_printf(cl, "#error;read;%s\n", strerror(-ret));
+}
+
+/* commands for the mux itself start with '#', everything else is
+ * "<phy>;<orca command>" and gets forwarded to that phy's api_control */
+static void
+client_handle_cmd(struct orca_client *cl, char *line)
+{
+	struct orca_phy *phy;
+	char *cmd, *name;
+	int ret;
+
+	if (line[0] == '#') {
+		cmd = strsep(&line, ";");
+		if (!strcmp(cmd, "#filter"))
+			client_cmd_filter(cl, line);
+		else if (!strcmp(cmd, "#phys"))
+			client_cmd_phys(cl);
+		else if (!strcmp(cmd, "#read"))
+			client_cmd_read(cl, line);
+		else if (!strcmp(cmd, "#export")) {
+			if (orca_export_start(cl, line))
+				orca_client_printf(cl, "#error;export;invalid argument\n");
+		}
+		else
+			orca_client_printf(cl, "#error;%s;unknown command\n",
+				       cmd + 1);
+		return;
+	}
+
+	name = strsep(&line, ";");
+	if (!line || !*line)
+		return;
+
+	list_for_each_entry(phy, &phys, list) {
+		if (strcmp(name, "*") != 0 && strcmp(name, phy->name) != 0)
+			continue;
+
+		ret = orca_phy_control(phy, line, strlen(line));
+		if (ret)
+			orca_client_printf(cl, "#error;%s;%s;%s\n",
+				       phy->name, line, strerror(-ret));
+	}
+}
+
+static void
+client_notify_read(struct ustream *s, int bytes)
+{
+	struct orca_client *cl = container_of(s, struct orca_client, sfd.stream);
+	char *buf, *nl;
+	int len, cur;
+
+	/* a line may span several read buffers, collect it in cl->cmd */
+	while (1) {
+		buf = ustream_get_read_buf(s, &len);
+		if (!buf || !len)
+			break;
+
+		nl = memchr(buf, '\n', len);
+		if (nl)
+			len = nl + 1 - buf;
+
+		cur = len;
+		if (cur > ORCA_CMD_MAX - cl->cmd_len) {
+			cur = ORCA_CMD_MAX - cl->cmd_len;
+			cl->cmd_skip = true;
+		}
+
+		memcpy(cl->cmd + cl->cmd_len, buf, cur);
+		cl->cmd_len += cur;
+		ustream_consume(s, len);
+
+		if (!nl)
+			continue;
+
+		if (!cl->cmd_skip) {
+			cl->cmd[--cl->cmd_len] = 0;
+			if (cl->cmd_len && cl->cmd[cl->cmd_len - 1] == '\r')
+				cl->cmd[--cl->cmd_len] = 0;
+
+			client_handle_cmd(cl, cl->cmd);
+		}
+
+		cl->cmd_len = 0;
+		cl->cmd_skip = false;
+	}
+}
+
+void orca_client_accept(int fd)
+{
+	struct orca_client *cl;
+
+	cl = calloc(1, sizeof(*cl));
+	if (!cl) {
+		close(fd);
+		return;
+	}
+
+	cl->phy_mask = ~0U;
+	cl->ev_mask = ORCA_EV_ALL;
+
+	cl->sfd.stream.notify_read = client_notify_read;
+	cl->sfd.stream.notify_state = client_notify_state;
+	ustream_fd_init(&cl->sfd, fd);
+	list_add_tail(&cl->list, &clients);
+
+	ULOG_INFO("client %p connected\n", cl);
+	orca_client_printf(cl, "#orca-mux;%s\n", ORCA_MUX_VERSION);
+	client_cmd_phys(cl);
+}
+
+/*
+ * Each client gets the lines matching its filter in a single write. Clients
+ * that do not keep up are not waited for: once more than max_pending bytes
+ * are queued for a client, its events are dropped (and counted) until the
+ * queue drained, so it can neither stall the relay nor other clients.
+ */
+void orca_client_dispatch(struct orca_phy *phy, struct orca_line *lines,
+			  int n_lines)
+{
+	struct orca_client *cl;
+	int name_len = strlen(phy->name);
+	size_t len, max_len = 0;
+	int i, n;
+
+	for (i = 0; i < n_lines; i++)
+		max_len += name_len + lines[i].len + 2;
+
+	if (!client_reserve(max_len))
+		return;
+
+	list_for_each_entry(cl, &clients, list) {
+		if (!(cl->phy_mask & (1U << phy->idx)))
+			continue;
+
+		len = 0;
+		n = 0;
+		for (i = 0; i < n_lines; i++) {
+			if (!(cl->ev_mask & (1U << lines[i].type)))
+				continue;
+
+			memcpy(out_buf + len, phy->name, name_len);
+			len += name_len;
+			out_buf[len++] = ';';
+			memcpy(out_buf + len, lines[i].data, lines[i].len);
+			len += lines[i].len;
+			out_buf[len++] = '\n';
+			n++;
+		}
+
+		if (len)
+			client_write(cl, out_buf, len, n);
+	}
+}
+
+void orca_client_broadcast(const char *fmt, ...)
+{
+	struct orca_client *cl;
+	va_list ap;
+
+	list_for_each_entry(cl, &clients, list) {
+		va_start(ap, fmt);
+		client_vprintf(cl, fmt, ap);
+		va_end(ap);
+	}
+}
+
+void orca_client_done(void)
+{
+	struct orca_client *cl, *tmp;
+
+	list_for_each_entry_safe(cl, tmp, &clients, list)
+		client_free(cl);
+
+	free(out_buf);
+}
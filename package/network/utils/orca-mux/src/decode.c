@@ -0,0 +1,190 @@
+/*
+ * orca-mux-decode - host side decoder for orca-mux export streams
+ *
+ * Copyright (C) 2024 SupraCoNeX <supraconex@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Reads an orca-mux stream in export mode from stdin. orca-mux only accepts
+ * TCP clients from the AP itself by default, so with option listen set to
+ * '127.0.0.1:21059' the stream is tunnelled over ssh, e.g.
+ *
+ *   (echo '#export;lz4'; cat) | ssh root@<ap> nc 127.0.0.1 21059 | \
+ *	orca-mux-decode -s
+ *
+ * Remote collectors can connect directly to <ap> 21059 once listen is set
+ * to '0.0.0.0:21059'. The plain event lines are written to stdout, lost
+ * frames are reported as "#lost;<n>" lines.
+ *
+ * The ratio printed by -s is that of the captured stream and depends on the
+ * event mix of the AP, so measure it against real traffic. The compression
+ * cost on the AP side is measured with orca-mux-bench.
+ */
+#include <arpa/inet.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lz4.h>
+
+#include "orca-mux-proto.h"
+
+struct decode_stats {
+	unsigned long frames;
+	unsigned long lost;
+	unsigned long long wire_bytes;
+	unsigned long long raw_bytes;
+	double decode_time;
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool
+read_full(FILE *f, void *buf, size_t len)
+{
+	return fread(buf, 1, len, f) == len;
+}
+
+static void
+print_stats(struct decode_stats *st)
+{
+	fprintf(stderr, "frames:      %lu (%lu lost)\n", st->frames, st->lost);
+	fprintf(stderr, "wire bytes:  %llu\n", st->wire_bytes);
+	fprintf(stderr, "raw bytes:   %llu\n", st->raw_bytes);
+	if (st->wire_bytes)
+		fprintf(stderr, "ratio:       %.2f\n",
+			(double)st->raw_bytes / st->wire_bytes);
+	if (st->decode_time > 0)
+		fprintf(stderr, "decode rate: %.1f MB/s\n",
+			st->raw_bytes / st->decode_time / 1e6);
+}
+
+static int
+usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [-s]\n"
+		"Options:\n"
+		"  -s    Print frame, loss and compression statistics to stderr\n"
+		"\n", progname);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	struct decode_stats st = {};
+	struct orca_frame_hdr hdr;
+	char *in = NULL, *out = NULL, *line = NULL;
+	size_t in_size = 0, out_size = 0, line_size = 0;
+	uint32_t seq = 0, len, raw_len;
+	bool stats = false, first = true, acked = false;
+	double start;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "s")) != -1) {
+		switch (ch) {
+		case 's':
+			stats = true;
+			break;
+		default:
+			return usage(argv[0]);
+		}
+	}
+
+	/* pass through the plain text output (events, errors) up to the
+	 * acknowledgement of the export command, everything after it is framed
+	 */
+	while (getline(&line, &line_size, stdin) > 0) {
+		fputs(line, stdout);
+		if (!strncmp(line, "#export;", strlen("#export;"))) {
+			acked = true;
+			break;
+		}
+	}
+	free(line);
+	if (!acked)
+		return 0;
+
+	while (read_full(stdin, &hdr, sizeof(hdr))) {
+		if (ntohl(hdr.magic) != ORCA_FRAME_MAGIC ||
+		    hdr.version != ORCA_FRAME_VERSION) {
+			fprintf(stderr, "invalid frame header\n");
+			return 1;
+		}
+
+		len = ntohl(hdr.len);
+		raw_len = ntohl(hdr.raw_len);
+
+		if (len > in_size) {
+			in_size = len;
+			in = realloc(in, in_size);
+		}
+		if (raw_len > out_size) {
+			out_size = raw_len;
+			out = realloc(out, out_size);
+		}
+		if (!in || !out) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+
+		if (!read_full(stdin, in, len))
+			break;
+
+		if (!first && ntohl(hdr.seq) != seq) {
+			st.lost += ntohl(hdr.seq) - seq;
+			printf("#lost;%u\n", ntohl(hdr.seq) - seq);
+		}
+		seq = ntohl(hdr.seq) + 1;
+		first = false;
+
+		start = now();
+		switch (hdr.codec) {
+		case ORCA_CODEC_NONE:
+			if (len != raw_len)
+				goto invalid;
+			memcpy(out, in, len);
+			break;
+		case ORCA_CODEC_LZ4:
+			if (LZ4_decompress_safe(in, out, len, raw_len) != (int)raw_len)
+				goto invalid;
+			break;
+		default:
+			goto invalid;
+		}
+		st.decode_time += now() - start;
+
+		fwrite(out, 1, raw_len, stdout);
+
+		st.frames++;
+		st.wire_bytes += sizeof(hdr) + len;
+		st.raw_bytes += raw_len;
+	}
+
+	if (stats)
+		print_stats(&st);
+
+	free(in);
+	free(out);
+	return 0;
+
+invalid:
+	fprintf(stderr, "invalid frame %u\n", ntohl(hdr.seq));
+	return 1;
+}
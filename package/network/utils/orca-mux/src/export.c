@@ -0,0 +1,267 @@
+/*
+ * orca-mux - ORCA event multiplexer
+ *
+ * Copyright (C) 2024 SupraCoNeX <supraconex@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <lz4.h>
+
+#include "orca-mux.h"
+#include "orca-mux-proto.h"
+
+struct orca_export {
+	struct uloop_timeout flush;
+	struct orca_client *cl;
+
+	uint8_t codec;
+	uint32_t seq;
+
+	/* max. uncompressed payload per frame and max. batching delay */
+	unsigned int batch_size;
+	unsigned int delay;
+
+	/* pending uncompressed payload, grows beyond batch_size for long lines */
+	unsigned int len;
+	unsigned int size;
+	char *buf;
+
+	/* header and (compressed) payload of the frame being sent */
+	char *frame;
+};
+
+static unsigned long
+export_count_lines(const char *buf, unsigned int len)
+{
+	unsigned long n = 0;
+	const char *end = buf + len;
+
+	while ((buf = memchr(buf, '\n', end - buf)) != NULL) {
+		buf++;
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * Send the pending complete lines as one frame, a trailing partial line stays
+ * buffered until its end is written. With all set, everything is sent.
+ */
+static unsigned int
+export_flush(struct orca_export *ex, bool all)
+{
+	struct orca_frame_hdr *hdr = (struct orca_frame_hdr *)ex->frame;
+	struct ustream *s = &ex->cl->sfd.stream;
+	char *payload = ex->frame + sizeof(*hdr);
+	uint8_t codec = ORCA_CODEC_NONE;
+	unsigned int raw_len = ex->len;
+	const char *nl;
+	int len;
+
+	uloop_timeout_cancel(&ex->flush);
+	if (!all) {
+		nl = memrchr(ex->buf, '\n', ex->len);
+		raw_len = nl ? nl + 1 - ex->buf : 0;
+	}
+	if (!raw_len)
+		return 0;
+
+	len = raw_len;
+	if (ex->codec == ORCA_CODEC_LZ4) {
+		len = LZ4_compress_default(ex->buf, payload, raw_len,
+					   LZ4_compressBound(ex->size));
+
+		/* send incompressible data as is */
+		if (len > 0 && len < (int)raw_len) {
+			codec = ORCA_CODEC_LZ4;
+		} else {
+			memcpy(payload, ex->buf, raw_len);
+			len = raw_len;
+		}
+	}
+
+	hdr->magic = htonl(ORCA_FRAME_MAGIC);
+	hdr->version = ORCA_FRAME_VERSION;
+	hdr->codec = codec;
+	hdr->flags = 0;
+	hdr->seq = htonl(ex->seq++);
+	hdr->len = htonl(len);
+	hdr->raw_len = htonl(raw_len);
+
+	if (s->w.data_bytes + sizeof(*hdr) + len > max_pending)
+		ex->cl->dropped += export_count_lines(ex->buf, raw_len);
+	else
+		ustream_write(s, ex->frame, sizeof(*hdr) + len, false);
+
+	ex->len -= raw_len;
+	memmove(ex->buf, ex->buf + raw_len, ex->len);
+
+	return raw_len;
+}
+
+static int
+export_alloc(struct orca_export *ex, unsigned int size)
+{
+	unsigned int frame_size = sizeof(struct orca_frame_hdr) + size;
+	char *buf, *frame;
+
+	if (ex->codec == ORCA_CODEC_LZ4)
+		frame_size = sizeof(struct orca_frame_hdr) +
+			     LZ4_compressBound(size);
+
+	frame = realloc(ex->frame, frame_size);
+	if (!frame)
+		return -1;
+
+	/* uncompressed frames are assembled in place */
+	if (ex->codec == ORCA_CODEC_NONE) {
+		buf = frame + sizeof(struct orca_frame_hdr);
+	} else {
+		buf = realloc(ex->buf, size);
+		if (!buf) {
+			ex->frame = frame;
+			return -1;
+		}
+	}
+
+	ex->frame = frame;
+	ex->buf = buf;
+	ex->size = size;
+
+	return 0;
+}
+
+static void
+export_flush_cb(struct uloop_timeout *t)
+{
+	struct orca_export *ex = container_of(t, struct orca_export, flush);
+
+	export_flush(ex, false);
+}
+
+void orca_export_write(struct orca_client *cl, const char *data, int len)
+{
+	struct orca_export *ex = cl->export;
+	unsigned int size;
+	int cur;
+
+	while (len > 0) {
+		cur = ex->size - ex->len;
+		if (!cur) {
+			/*
+			 * A single line fills the whole buffer, make room for
+			 * it. Lines beyond the maximum batch size get split.
+			 */
+			size = ex->size * 2;
+			if (size > ORCA_EXPORT_BATCH_MAX)
+				size = ORCA_EXPORT_BATCH_MAX;
+
+			if (!export_flush(ex, false) &&
+			    (size == ex->size || export_alloc(ex, size) < 0))
+				export_flush(ex, true);
+			continue;
+		}
+
+		if (cur > len)
+			cur = len;
+
+		memcpy(ex->buf + ex->len, data, cur);
+		ex->len += cur;
+		data += cur;
+		len -= cur;
+
+		if (ex->len >= ex->batch_size)
+			export_flush(ex, false);
+	}
+
+	if (ex->len && !ex->flush.pending)
+		uloop_timeout_set(&ex->flush, ex->delay);
+}
+
+void orca_export_free(struct orca_client *cl)
+{
+	struct orca_export *ex = cl->export;
+
+	if (!ex)
+		return;
+
+	uloop_timeout_cancel(&ex->flush);
+	if (ex->codec != ORCA_CODEC_NONE)
+		free(ex->buf);
+	free(ex->frame);
+	free(ex);
+
+	cl->export = NULL;
+}
+
+/* "#export;none|lz4|off[;<batch kbytes>[;<delay ms>]]" */
+int orca_export_start(struct orca_client *cl, char *args)
+{
+	struct orca_export *ex = cl->export;
+	char *codec = strsep(&args, ";");
+	char *batch = strsep(&args, ";");
+	char *delay = strsep(&args, ";");
+
+	if (!codec)
+		return -1;
+
+	if (ex) {
+		export_flush(ex, true);
+		orca_export_free(cl);
+	}
+
+	if (!strcmp(codec, "off"))
+		return 0;
+
+	ex = calloc(1, sizeof(*ex));
+	if (!ex)
+		return -1;
+
+	ex->cl = cl;
+	ex->flush.cb = export_flush_cb;
+	ex->batch_size = ORCA_EXPORT_BATCH;
+	ex->delay = ORCA_EXPORT_DELAY;
+
+	if (!strcmp(codec, "lz4"))
+		ex->codec = ORCA_CODEC_LZ4;
+	else if (!strcmp(codec, "none"))
+		ex->codec = ORCA_CODEC_NONE;
+	else
+		goto error;
+
+	if (batch && *batch)
+		ex->batch_size = strtoul(batch, NULL, 0) * 1024;
+	if (delay && *delay)
+		ex->delay = strtoul(delay, NULL, 0);
+
+	if (!ex->batch_size || ex->batch_size > ORCA_EXPORT_BATCH_MAX)
+		goto error;
+
+	if (export_alloc(ex, ex->batch_size) < 0) {
+		free(ex->frame);
+		goto error;
+	}
+
+	/* acknowledge in plain text, everything after this is framed */
+	ustream_printf(&cl->sfd.stream, "#export;%s;%u;%u\n", codec,
+		       ex->batch_size / 1024, ex->delay);
+	cl->export = ex;
+
+	return 0;
+
+error:
+	free(ex);
+	return -1;
+}
@@ -0,0 +1,168 @@
+/*
+ * orca-mux - ORCA event multiplexer
+ *
+ * Copyright (C) 2024 SupraCoNeX <supraconex@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <libubox/ulog.h>
+#include <libubox/usock.h>
+
+#include "orca-mux.h"
+
+/* interval for picking up added or removed phys */
+#define ORCA_SCAN_INTERVAL	5000
+
+/* the mux gives full control over the rate control, so TCP clients are
+ * only accepted from the AP itself unless a host is given explicitly */
+#define ORCA_TCP_HOST		"127.0.0.1"
+
+const char *debugfs_path = ORCA_DEBUGFS_PATH;
+unsigned int max_pending = ORCA_MAX_PENDING;
+
+static struct uloop_fd tcp_server = { .fd = -1 };
+static struct uloop_fd unix_server = { .fd = -1 };
+static const char *unix_path;
+
+static void
+scan_timeout_cb(struct uloop_timeout *t)
+{
+	orca_phy_scan();
+	uloop_timeout_set(t, ORCA_SCAN_INTERVAL);
+}
+
+static struct uloop_timeout scan_timeout = {
+	.cb = scan_timeout_cb,
+};
+
+static void
+server_cb(struct uloop_fd *fd, unsigned int events)
+{
+	int cfd;
+
+	while (1) {
+		cfd = accept4(fd->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (cfd < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		orca_client_accept(cfd);
+	}
+}
+
+static int
+server_add(struct uloop_fd *fd, int type, const char *host, const char *port)
+{
+	fd->fd = usock(type | USOCK_SERVER | USOCK_NONBLOCK, host, port);
+	if (fd->fd < 0) {
+		ULOG_ERR("failed to listen on %s%s%s: %m\n", host ? host : "*",
+			 port ? ":" : "", port ? port : "");
+		return -1;
+	}
+
+	fd->cb = server_cb;
+	uloop_fd_add(fd, ULOOP_READ);
+	return 0;
+}
+
+static int
+usage(const char *progname)
+{
+	fprintf(stderr, "Usage: %s [options]\n"
+		"Options:\n"
+		"  -l [<host>:]<port>  Listen for TCP clients on <host>\n"
+		"                      (default: " ORCA_TCP_HOST ")\n"
+		"  -u <path>           Listen for clients on a unix socket\n"
+		"  -b <kbytes>         Max. queued output per client before dropping\n"
+		"                      events (default: %u)\n"
+		"  -d <path>           ieee80211 debugfs directory\n"
+		"                      (default: " ORCA_DEBUGFS_PATH ")\n"
+		"  -s                  Log to syslog\n"
+		"\n", progname, ORCA_MAX_PENDING / 1024);
+	return 1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *tcp_host = ORCA_TCP_HOST, *tcp_port = NULL;
+	int log_channels = ULOG_STDIO;
+	char *sep;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "l:u:b:d:s")) != -1) {
+		switch (ch) {
+		case 'l':
+			sep = strrchr(optarg, ':');
+			if (sep) {
+				*sep = 0;
+				tcp_host = optarg;
+				tcp_port = sep + 1;
+			} else {
+				tcp_port = optarg;
+			}
+			break;
+		case 'u':
+			unix_path = optarg;
+			break;
+		case 'b':
+			max_pending = strtoul(optarg, NULL, 0) * 1024;
+			break;
+		case 'd':
+			debugfs_path = optarg;
+			break;
+		case 's':
+			log_channels = ULOG_SYSLOG;
+			break;
+		default:
+			return usage(argv[0]);
+		}
+	}
+
+	if (!tcp_port && !unix_path)
+		return usage(argv[0]);
+
+	ulog_open(log_channels, LOG_DAEMON, "orca-mux");
+	signal(SIGPIPE, SIG_IGN);
+
+	uloop_init();
+
+	if (tcp_port && server_add(&tcp_server, USOCK_TCP, tcp_host, tcp_port))
+		return 1;
+
+	if (unix_path) {
+		unlink(unix_path);
+		if (server_add(&unix_server, USOCK_UNIX, unix_path, NULL))
+			return 1;
+	}
+
+	scan_timeout_cb(&scan_timeout);
+	uloop_run();
+
+	orca_client_done();
+	orca_phy_done();
+
+	if (unix_path)
+		unlink(unix_path);
+
+	uloop_done();
+	ulog_close();
+
+	return 0;
+}
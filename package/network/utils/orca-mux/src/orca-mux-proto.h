@@ -0,0 +1,50 @@
+/*
+ * orca-mux - ORCA event multiplexer
+ *
+ * Copyright (C) 2024 SupraCoNeX <supraconex@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __ORCA_MUX_PROTO_H
+#define __ORCA_MUX_PROTO_H
+
+#include <stdint.h>
+
+/*
+ * Export mode wire format, shared with the host side decoder.
+ *
+ * After "#export;<codec>..." has been acknowledged in plain text, all
+ * further output to the client is sent as frames: a header followed by
+ * len bytes of payload, which decompress to raw_len bytes of event lines.
+ * Frames only ever end on a line boundary, a line longer than the batch
+ * size makes its frame grow up to the 1 MB batch limit. Every frame
+ * consumes a sequence number, including frames dropped due to
+ * backpressure, so gaps in seq tell the collector how many frames were
+ * lost.
+ */
+#define ORCA_FRAME_MAGIC	0x4f4d5558	/* "OMUX" */
+#define ORCA_FRAME_VERSION	1
+
+enum orca_frame_codec {
+	ORCA_CODEC_NONE,
+	ORCA_CODEC_LZ4,
+};
+
+struct orca_frame_hdr {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t codec;
+	uint16_t flags;
+	uint32_t seq;
+	uint32_t len;
+	uint32_t raw_len;
+} __attribute__((packed));
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * orca-mux - ORCA event multiplexer
+ *
+ * Copyright (C) 2024 SupraCoNeX <supraconex@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef __ORCA_MUX_H
+#define __ORCA_MUX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libubox/list.h>
+#include <libubox/uloop.h>
+#include <libubox/ustream.h>
+
+#define ORCA_MUX_VERSION	"1"
+
+#define ORCA_DEBUGFS_PATH	"/sys/kernel/debug/ieee80211"
+#define ORCA_MAX_PHYS		32
+#define ORCA_READ_BUF		(64 * 1024)
+#define ORCA_MAX_LINES		1024
+#define ORCA_CMD_MAX		256
+
+/* default amount of queued output after which events for a client get dropped */
+#define ORCA_MAX_PENDING	(1024 * 1024)
+
+/* export mode defaults: uncompressed bytes per frame and max. batching delay */
+#define ORCA_EXPORT_BATCH	(64 * 1024)
+#define ORCA_EXPORT_BATCH_MAX	(1024 * 1024)
+#define ORCA_EXPORT_DELAY	100
+
+enum orca_event_type {
+	ORCA_EV_TXS,
+	ORCA_EV_RXS,
+	ORCA_EV_STATS,
+	ORCA_EV_BEST_RATES,
+	ORCA_EV_SAMPLE_RATES,
+	ORCA_EV_EST_TP,
+	ORCA_EV_STA,
+	ORCA_EV_SURVEY,
+	ORCA_EV_AGG,
+
+	/* command echoes and everything else, keep last */
+	ORCA_EV_OTHER,
+	__ORCA_EV_MAX
+};
+
+#define ORCA_EV_ALL		((1U << __ORCA_EV_MAX) - 1)
+
+struct orca_line {
+	const char *data;
+	int len;
+	uint32_t type;
+};
+
+struct orca_phy {
+	struct list_head list;
+	struct uloop_fd ev;
+	int ctrl_fd;
+
+	/* bit used in per-client phy filters */
+	int idx;
+	char name[16];
+	bool present;
+
+	unsigned int len;
+	char buf[ORCA_READ_BUF];
+};
+
+struct orca_export;
+
+struct orca_client {
+	struct list_head list;
+	struct ustream_fd sfd;
+
+	/* framed/compressed output, NULL for plain text */
+	struct orca_export *export;
+
+	uint32_t phy_mask;
+	uint32_t ev_mask;
+
+	unsigned long dropped;
+
+	/* command line being received, overlong ones are skipped */
+	char cmd[ORCA_CMD_MAX];
+	int cmd_len;
+	bool cmd_skip;
+};
+
+extern struct list_head phys;
+extern struct list_head clients;
+extern const char *debugfs_path;
+extern unsigned int max_pending;
+
+extern const char * const orca_event_names[__ORCA_EV_MAX];
+
+void orca_phy_scan(void);
+void orca_phy_done(void);
+struct orca_phy *orca_phy_get(const char *name);
+int orca_phy_control(struct orca_phy *phy, const char *cmd, int len);
+int orca_phy_read_file(struct orca_phy *phy, const char *file,
+		       struct orca_client *cl);
+
+void orca_client_accept(int fd);
+void orca_client_dispatch(struct orca_phy *phy, struct orca_line *lines,
+			  int n_lines);
+void orca_client_broadcast(const char *fmt, ...);
+void orca_client_printf(struct orca_client *cl, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+void orca_client_done(void);
+
+int orca_export_start(struct orca_client *cl, char *args);
+void orca_export_write(struct orca_client *cl, const char *data, int len);
+void orca_export_free(struct orca_client *cl);
+
+#endif
@@ -0,0 +1,281 @@
+/*
+ * orca-mux - ORCA event multiplexer
+ *
+ * Copyright (C) 2024 SupraCoNeX <supraconex@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2
+ * as published by the Free Software Foundation
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libubox/ulog.h>
+
+#include "orca-mux.h"
+
+LIST_HEAD(phys);
+
+const char * const orca_event_names[__ORCA_EV_MAX] = {
+	[ORCA_EV_TXS] = "txs",
+	[ORCA_EV_RXS] = "rxs",
+	[ORCA_EV_STATS] = "stats",
+	[ORCA_EV_BEST_RATES] = "best_rates",
+	[ORCA_EV_SAMPLE_RATES] = "sample_rates",
+	[ORCA_EV_EST_TP] = "est_tp",
+	[ORCA_EV_STA] = "sta",
+	[ORCA_EV_SURVEY] = "survey",
+	[ORCA_EV_AGG] = "agg",
+	[ORCA_EV_OTHER] = "other",
+};
+
+static uint32_t phy_idx_used;
+
+static void
+phy_path(char *buf, size_t len, const char *phy, const char *file)
+{
+	snprintf(buf, len, "%s/%s/rc/%s", debugfs_path, phy, file);
+}
+
+/* events look like "<timestamp>;<type>;...", classify by the type field */
+static uint32_t
+phy_event_type(const char *line, int len)
+{
+	const char *type, *end;
+	int i, type_len;
+
+	type = memchr(line, ';', len);
+	if (!type)
+		return ORCA_EV_OTHER;
+
+	type++;
+	end = memchr(type, ';', line + len - type);
+	type_len = end ? end - type : line + len - type;
+
+	for (i = 0; i < ORCA_EV_OTHER; i++) {
+		if (!strncmp(type, orca_event_names[i], type_len) &&
+		    !orca_event_names[i][type_len])
+			return i;
+	}
+
+	return ORCA_EV_OTHER;
+}
+
+static void
+phy_process(struct orca_phy *phy)
+{
+	struct orca_line lines[ORCA_MAX_LINES];
+	char *start = phy->buf, *end = phy->buf + phy->len, *nl;
+	int n_lines = 0;
+
+	while (start < end && (nl = memchr(start, '\n', end - start)) != NULL) {
+		lines[n_lines].data = start;
+		lines[n_lines].len = nl - start;
+		lines[n_lines].type = phy_event_type(start, nl - start);
+		start = nl + 1;
+
+		if (++n_lines < ORCA_MAX_LINES)
+			continue;
+
+		orca_client_dispatch(phy, lines, n_lines);
+		n_lines = 0;
+	}
+
+	if (n_lines)
+		orca_client_dispatch(phy, lines, n_lines);
+
+	phy->len = end - start;
+	if (phy->len == sizeof(phy->buf)) {
+		ULOG_ERR("%s: discarding overlong event data\n", phy->name);
+		phy->len = 0;
+	} else if (phy->len && start != phy->buf) {
+		memmove(phy->buf, start, phy->len);
+	}
+}
+
+static void
+phy_free(struct orca_phy *phy)
+{
+	ULOG_INFO("%s: removed\n", phy->name);
+	orca_client_broadcast("#phy;remove;%s\n", phy->name);
+
+	uloop_fd_delete(&phy->ev);
+	close(phy->ev.fd);
+	if (phy->ctrl_fd >= 0)
+		close(phy->ctrl_fd);
+
+	phy_idx_used &= ~(1U << phy->idx);
+	list_del(&phy->list);
+	free(phy);
+}
+
+static void
+phy_ev_cb(struct uloop_fd *fd, unsigned int events)
+{
+	struct orca_phy *phy = container_of(fd, struct orca_phy, ev);
+	ssize_t len;
+
+	while (1) {
+		len = read(fd->fd, phy->buf + phy->len,
+			   sizeof(phy->buf) - phy->len);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+
+			ULOG_ERR("%s: read failed: %m\n", phy->name);
+			phy_free(phy);
+			return;
+		}
+
+		/* relay channels return 0 when no data is pending */
+		if (!len)
+			break;
+
+		phy->len += len;
+		phy_process(phy);
+	}
+}
+
+static void
+phy_add(const char *name)
+{
+	struct orca_phy *phy;
+	char path[PATH_MAX];
+	int fd, idx;
+
+	for (idx = 0; idx < ORCA_MAX_PHYS; idx++)
+		if (!(phy_idx_used & (1U << idx)))
+			break;
+
+	if (idx == ORCA_MAX_PHYS) {
+		ULOG_ERR("%s: too many phys\n", name);
+		return;
+	}
+
+	phy_path(path, sizeof(path), name, "api_event");
+	fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		ULOG_ERR("%s: failed to open %s: %m\n", name, path);
+		return;
+	}
+
+	phy = calloc(1, sizeof(*phy));
+	if (!phy) {
+		close(fd);
+		return;
+	}
+
+	snprintf(phy->name, sizeof(phy->name), "%s", name);
+	phy->idx = idx;
+	phy->ctrl_fd = -1;
+	phy->present = true;
+	phy->ev.fd = fd;
+	phy->ev.cb = phy_ev_cb;
+	uloop_fd_add(&phy->ev, ULOOP_READ);
+
+	phy_idx_used |= 1U << idx;
+	list_add_tail(&phy->list, &phys);
+
+	ULOG_INFO("%s: added\n", phy->name);
+	orca_client_broadcast("#phy;add;%s\n", phy->name);
+}
+
+void orca_phy_scan(void)
+{
+	struct orca_phy *phy, *tmp;
+	char pattern[PATH_MAX];
+	glob_t gl;
+	size_t i;
+
+	list_for_each_entry(phy, &phys, list)
+		phy->present = false;
+
+	snprintf(pattern, sizeof(pattern), "%s/*/rc/api_event", debugfs_path);
+	if (!glob(pattern, 0, NULL, &gl)) {
+		for (i = 0; i < gl.gl_pathc; i++) {
+			char *name = gl.gl_pathv[i] + strlen(debugfs_path) + 1;
+
+			*strchr(name, '/') = 0;
+			phy = orca_phy_get(name);
+			if (phy)
+				phy->present = true;
+			else
+				phy_add(name);
+		}
+		globfree(&gl);
+	}
+
+	list_for_each_entry_safe(phy, tmp, &phys, list)
+		if (!phy->present)
+			phy_free(phy);
+}
+
+void orca_phy_done(void)
+{
+	struct orca_phy *phy, *tmp;
+
+	list_for_each_entry_safe(phy, tmp, &phys, list)
+		phy_free(phy);
+}
+
+struct orca_phy *orca_phy_get(const char *name)
+{
+	struct orca_phy *phy;
+
+	list_for_each_entry(phy, &phys, list)
+		if (!strcmp(phy->name, name))
+			return phy;
+
+	return NULL;
+}
+
+int orca_phy_control(struct orca_phy *phy, const char *cmd, int len)
+{
+	char path[PATH_MAX];
+
+	if (phy->ctrl_fd < 0) {
+		phy_path(path, sizeof(path), phy->name, "api_control");
+		phy->ctrl_fd = open(path, O_WRONLY | O_CLOEXEC);
+		if (phy->ctrl_fd < 0)
+			return -errno;
+	}
+
+	/* api_control handles exactly one command per write */
+	if (write(phy->ctrl_fd, cmd, len) < 0)
+		return -errno;
+
+	return 0;
+}
+
+int orca_phy_read_file(struct orca_phy *phy, const char *file,
+		       struct orca_client *cl)
+{
+	char path[PATH_MAX], *line = NULL;
+	size_t line_size = 0;
+	FILE *f;
+
+	phy_path(path, sizeof(path), phy->name, file);
+	f = fopen(path, "r");
+	if (!f)
+		return -errno;
+
+	while (getline(&line, &line_size, f) > 0)
+		orca_client_printf(cl, "%s;%s", phy->name, line);
+
+	free(line);
+	fclose(f);
+	return 0;
+}
@@ -38,6 +38,10 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+#ifdef __ARM_FEATURE_CRC32
+#include <arm_acle.h>
+#endif
 
 const uint32_t crc32_table[256] = {
 	0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
@@ -93,3 +97,67 @@ const uint32_t crc32_table[256] = {
 	0x5d681b02L, 0x2a6f2b94L, 0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL,
 	0x2d02ef8dL
 };
+
+#ifdef __ARM_FEATURE_CRC32
+/* ARMv8 CRC32 instructions use the same (reflected) polynomial */
+uint32_t
+crc32(uint32_t val, const void *ss, int len)
+{
+	const unsigned char *s = ss;
+	uint64_t v;
+
+	for (; len >= 8; len -= 8, s += 8) {
+		memcpy(&v, s, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		v = __builtin_bswap64(v);
+#endif
+		val = __crc32d(val, v);
+	}
+	while (--len >= 0)
+		val = __crc32b(val, *s++);
+	return val;
+}
+#else
+/*
+ * Slice-by-8: crc32_slice[k][b] is the CRC of byte b followed by k zero
+ * bytes, so eight input bytes can be folded in with eight independent
+ * table lookups instead of eight dependent ones.
+ */
+static uint32_t crc32_slice[8][256];
+
+static void __attribute__((constructor))
+crc32_init_slice(void)
+{
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		crc32_slice[0][i] = crc32_table[i];
+		for (k = 1; k < 8; k++)
+			crc32_slice[k][i] = crc32_table[crc32_slice[k - 1][i] & 0xff] ^
+					    (crc32_slice[k - 1][i] >> 8);
+	}
+}
+
+uint32_t
+crc32(uint32_t val, const void *ss, int len)
+{
+	const unsigned char *s = ss;
+	uint32_t one, two;
+
+	for (; len >= 8; len -= 8, s += 8) {
+		one = val ^ (s[0] | s[1] << 8 | s[2] << 16 | (uint32_t)s[3] << 24);
+		two = s[4] | s[5] << 8 | s[6] << 16 | (uint32_t)s[7] << 24;
+		val = crc32_slice[7][one & 0xff] ^
+		      crc32_slice[6][(one >> 8) & 0xff] ^
+		      crc32_slice[5][(one >> 16) & 0xff] ^
+		      crc32_slice[4][one >> 24] ^
+		      crc32_slice[3][two & 0xff] ^
+		      crc32_slice[2][(two >> 8) & 0xff] ^
+		      crc32_slice[1][(two >> 16) & 0xff] ^
+		      crc32_slice[0][two >> 24];
+	}
+	while (--len >= 0)
+		val = crc32_table[(val ^ *s++) & 0xff] ^ (val >> 8);
+	return val;
+}
+#endif
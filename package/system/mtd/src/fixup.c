@@ -0,0 +1,125 @@
+/*
+ * fixup.c
+ *
+ * Shared checksum pass for the image header fixups
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "mtd.h"
+#include "crc32.h"
+#include "fixup.h"
+
+/*
+ * The fixups used to read the whole image into one buffer before
+ * checksumming it. Stream it in chunks of this size instead.
+ */
+#define FIXUP_BUF_SIZE	(256 * 1024)
+
+void
+fixup_sum_init(struct fixup_sum *s, unsigned int flags)
+{
+	s->flags = flags;
+	s->len = 0;
+	s->crc = 0xFFFFFFFF;
+	if (flags & FIXUP_MD5)
+		MD5_Init(&s->md5);
+}
+
+void
+fixup_sum_update(struct fixup_sum *s, const void *data, size_t len)
+{
+	if (s->flags & FIXUP_CRC32)
+		s->crc = crc32(s->crc, data, len);
+	if (s->flags & FIXUP_MD5)
+		MD5_Update(&s->md5, data, len);
+	s->len += len;
+}
+
+void
+fixup_sum_final(struct fixup_sum *s)
+{
+	if (s->flags & FIXUP_MD5)
+		MD5_Final(s->digest, &s->md5);
+}
+
+/* length of the run of good blocks starting at offset, at most len */
+static size_t
+fixup_good_run(int fd, size_t offset, size_t len)
+{
+	size_t run = 0, block;
+
+	while (run < len) {
+		block = (offset + run) & ~(erasesize - 1);
+		if (mtd_block_is_bad(fd, block))
+			break;
+		run = block + erasesize - offset;
+	}
+
+	return run < len ? run : len;
+}
+
+/*
+ * Feed len bytes of the device at offset to all checksums in a single pass.
+ * With skip_bad, data in bad blocks is left out, like CFE does when it
+ * loads the image.
+ */
+int
+fixup_sum_read(struct fixup_sum *s, int fd, size_t offset, size_t len, bool skip_bad)
+{
+	size_t bufsize = FIXUP_BUF_SIZE;
+	size_t chunk;
+	ssize_t res;
+	char *buf;
+	int err = 0;
+
+	if (bufsize < erasesize)
+		bufsize = erasesize;
+
+	buf = malloc(bufsize);
+	if (!buf)
+		return -ENOMEM;
+
+	while (len) {
+		chunk = len < bufsize ? len : bufsize;
+
+		if (skip_bad) {
+			chunk = fixup_good_run(fd, offset, chunk);
+			if (!chunk) {
+				chunk = erasesize - (offset & (erasesize - 1));
+				if (chunk > len)
+					chunk = len;
+				offset += chunk;
+				len -= chunk;
+				continue;
+			}
+		}
+
+		res = pread(fd, buf, chunk, offset);
+		if (res != chunk) {
+			perror("pread");
+			err = -EIO;
+			break;
+		}
+
+		fixup_sum_update(s, buf, chunk);
+		offset += chunk;
+		len -= chunk;
+	}
+
+	free(buf);
+	return err;
+}
@@ -0,0 +1,26 @@
+#ifndef __fixup_h
+#define __fixup_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "md5.h"
+
+/* checksums computed by a fixup pass */
+#define FIXUP_CRC32	(1 << 0)
+#define FIXUP_MD5	(1 << 1)
+
+struct fixup_sum {
+	unsigned int flags;
+	size_t len;		/* bytes passed to the checksums */
+	uint32_t crc;		/* not inverted, as returned by crc32buf() */
+	MD5_CTX md5;
+	unsigned char digest[16];
+};
+
+extern void fixup_sum_init(struct fixup_sum *s, unsigned int flags);
+extern void fixup_sum_update(struct fixup_sum *s, const void *data, size_t len);
+extern int fixup_sum_read(struct fixup_sum *s, int fd, size_t offset, size_t len, bool skip_bad);
+extern void fixup_sum_final(struct fixup_sum *s);
+
+#endif /* __fixup_h */
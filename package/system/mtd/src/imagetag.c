@@ -146,29 +146,6 @@ static uint32_t strntoul(char *str, char **endptr, int base, size_t len) {
   return res;
 }
 
-uint32_t compute_crc32(uint32_t crc, off_t start, size_t compute_len, int fd)
-{
-	uint8_t readbuf[1024];
-	ssize_t res;
-	off_t offset = start;
-
-	/* Read a buffer's worth of bytes  */
-	while (fd && (compute_len >= sizeof(readbuf))) {
-		res = pread(fd, readbuf, sizeof(readbuf), offset);
-		crc = crc32(crc, readbuf, res);
-		compute_len = compute_len - res;
-		offset += res;
-	}
-
-	/* Less than buffer-size bytes remains, read compute_len bytes */
-	if (fd && (compute_len > 0)) {
-	  res = pread(fd, readbuf, compute_len, offset);
-	  crc = crc32(crc, readbuf, res);
-	}
-
-	return crc;
-}
-
 int
 trx_fixup(int fd, const char *name)
 {
@@ -180,7 +157,6 @@ trx_fixup(int fd, const char *name)
 	ssize_t res;
 	uint32_t cfelen, imagelen, imagestart, rootfslen;
 	uint32_t imagecrc, rootfscrc, headercrc;
-	uint32_t offset = 0;
 	cfelen = imagelen = imagestart = imagecrc = rootfscrc = headercrc = rootfslen = 0;
 
 
@@ -210,7 +186,7 @@ trx_fixup(int fd, const char *name)
 	  exit(1);
 	}
 
-	headercrc = compute_crc32(CRC_START, offset, offsetof(struct bcm_tag, header_crc), fd);
+	headercrc = crc32(CRC_START, tag, offsetof(struct bcm_tag, header_crc));
 	if (headercrc != *(uint32_t *)(&tag->header_crc)) {
 		fprintf(stderr, "Tag verify failed.  This may not be a valid image.\n");
 		exit(1);
@@ -343,7 +319,7 @@ mtd_fixtrx(const char *mtd, size_t offset, size_t data_size)
 	  fprintf(stderr, "Verifying we actually have an imagetag.\n");
 	}
 
-	headercrc = compute_crc32(CRC_START, offset, offsetof(struct bcm_tag, header_crc), fd);
+	headercrc = crc32(CRC_START, tag, offsetof(struct bcm_tag, header_crc));
 	if (headercrc != *(uint32_t *)(&tag->header_crc)) {
 		fprintf(stderr, "Tag verify failed.  This may not be a valid image.\n");
 		exit(1);
@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/syscall.h>
 #include <fcntl.h>
@@ -45,12 +46,14 @@
 #include <linux/reboot.h>
 #include <mtd/mtd-user.h>
 #include "crc32.h"
+#include "sha256.h"
 #include "fis.h"
 #include "mtd.h"
 
 #include <libubox/md5.h>
 
 #define MAX_ARGS 8
+#define IMAGE_READAHEAD_BLOCKS	4
 #define JFFS2_DEFAULT_DIR	"" /* directory name without /, empty means root dir */
 
 #define TRX_MAGIC		0x48445230	/* "HDR0" */
@@ -90,6 +93,12 @@ static char *tpl_uboot_args_part;
 static int buflen = 0;
 int quiet;
 int no_erase;
+static int differential;
+static enum {
+	VERIFY_MD5,
+	VERIFY_SHA256,
+	VERIFY_CRC32,
+} verify_type = VERIFY_MD5;
 int mtdsize = 0;
 int erasesize = 0;
 int jffs2_skip_bytes=0;
@@ -184,6 +193,178 @@ int mtd_write_buffer(int fd, const char *buf, int offset, int length)
 	return 0;
 }
 
+/* read back an eraseblock and check if it already contains the new data */
+static int
+mtd_block_unchanged(int fd, int offset, const char *data)
+{
+	static char *cmpbuf;
+	ssize_t r;
+	int len = 0;
+
+	if (!cmpbuf)
+		cmpbuf = malloc(erasesize);
+	if (!cmpbuf)
+		return 0;
+
+	while (len < erasesize) {
+		r = pread(fd, cmpbuf + len, erasesize - len, offset + len);
+		if (r < 0 && errno == EINTR)
+			continue;
+		/* unreadable (e.g. uncorrectable ECC errors), just rewrite it */
+		if (r <= 0)
+			return 0;
+
+		len += r;
+	}
+
+	return !memcmp(cmpbuf, data, erasesize);
+}
+
+static uint64_t
+time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * The image is read by a separate thread into a ring buffer a few eraseblocks
+ * ahead, so that a slow image source (pipe, network) and the flash erase/write
+ * cycles overlap instead of taking turns.
+ */
+static struct image_reader {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int fd;
+	char *data;
+	size_t size;
+	size_t head;
+	size_t fill;
+	int eof;
+	int err;
+} reader;
+
+static void *
+image_reader_thread(void *arg)
+{
+	struct image_reader *rd = arg;
+	size_t pos, len;
+	ssize_t r;
+
+	/* only a blocking read may be cancelled, see image_reader_stop() */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+	pthread_mutex_lock(&rd->lock);
+	while (!rd->eof) {
+		if (rd->fill == rd->size) {
+			pthread_cond_wait(&rd->cond, &rd->lock);
+			continue;
+		}
+
+		pos = (rd->head + rd->fill) % rd->size;
+		len = MIN(rd->size - rd->fill, rd->size - pos);
+		pthread_mutex_unlock(&rd->lock);
+
+		/* the consumer never touches the free part of the ring */
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		r = read(rd->fd, rd->data + pos, len);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+		pthread_mutex_lock(&rd->lock);
+		if (r < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+
+		if (r < 0)
+			rd->err = errno;
+		if (r <= 0)
+			rd->eof = 1;
+		else
+			rd->fill += r;
+
+		pthread_cond_signal(&rd->cond);
+	}
+	pthread_mutex_unlock(&rd->lock);
+
+	return NULL;
+}
+
+static void
+image_reader_start(int fd)
+{
+	reader.fd = fd;
+	reader.size = IMAGE_READAHEAD_BLOCKS * erasesize;
+	reader.data = malloc(reader.size);
+	if (!reader.data)
+		return;
+
+	pthread_mutex_init(&reader.lock, NULL);
+	pthread_cond_init(&reader.cond, NULL);
+
+	if (pthread_create(&reader.thread, NULL, image_reader_thread, &reader)) {
+		/* fall back to reading synchronously */
+		free(reader.data);
+		reader.data = NULL;
+	}
+}
+
+static void
+image_reader_stop(void)
+{
+	if (!reader.data)
+		return;
+
+	/* stop reading ahead, in case the caller bailed out before EOF */
+	pthread_mutex_lock(&reader.lock);
+	reader.eof = 1;
+	pthread_cond_signal(&reader.cond);
+	pthread_mutex_unlock(&reader.lock);
+
+	/* the thread may be blocked reading from a pipe that never ends */
+	pthread_cancel(reader.thread);
+	pthread_join(reader.thread, NULL);
+	pthread_cond_destroy(&reader.cond);
+	pthread_mutex_destroy(&reader.lock);
+	free(reader.data);
+	reader.data = NULL;
+}
+
+static ssize_t
+image_read(int fd, char *dest, size_t len)
+{
+	struct image_reader *rd = &reader;
+	size_t n;
+
+	if (!rd->data)
+		return read(fd, dest, len);
+
+	pthread_mutex_lock(&rd->lock);
+	while (!rd->fill && !rd->eof)
+		pthread_cond_wait(&rd->cond, &rd->lock);
+	n = MIN(len, MIN(rd->fill, rd->size - rd->head));
+	pthread_mutex_unlock(&rd->lock);
+
+	if (!n) {
+		if (rd->err) {
+			errno = rd->err;
+			return -1;
+		}
+		return 0;
+	}
+
+	memcpy(dest, rd->data + rd->head, n);
+
+	pthread_mutex_lock(&rd->lock);
+	rd->head = (rd->head + n) % rd->size;
+	rd->fill -= n;
+	pthread_cond_signal(&rd->cond);
+	pthread_mutex_unlock(&rd->lock);
+
+	return n;
+}
+
 static int
 image_check(int imagefd, const char *mtd)
 {
@@ -347,10 +528,29 @@ mtd_erase(const char *mtd)
 
 }
 
+static int
+write_full(int fd, const char *data, int len)
+{
+	int r;
+
+	while (len > 0) {
+		r = write(fd, data, len);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		data += r;
+		len -= r;
+	}
+
+	return 0;
+}
+
 static int
 mtd_dump(const char *mtd, int part_offset, int size)
 {
-	int ret = 0, offset = 0;
+	int ret = 0, offset = part_offset;
 	int fd;
 	char *buf;
 
@@ -366,17 +566,23 @@ mtd_dump(const char *mtd, int part_offset, int size)
 	if (!size)
 		size = mtdsize;
 
-	if (part_offset)
-		lseek(fd, part_offset, SEEK_SET);
-
 	buf = malloc(erasesize);
 	if (!buf)
 		return -1;
 
 	do {
 		int len = (size > erasesize) ? (erasesize) : (size);
-		int rlen = read(fd, buf, len);
+		int rlen;
 
+		/* stay within one eraseblock, so bad blocks are skipped as a whole */
+		len = MIN(len, erasesize - offset % erasesize);
+		if (mtd_block_is_bad(fd, offset - offset % erasesize)) {
+			fprintf(stderr, "skipping bad block at 0x%08x\n", offset);
+			offset += len;
+			continue;
+		}
+
+		rlen = pread(fd, buf, len, offset);
 		if (rlen < 0) {
 			if (errno == EINTR)
 				continue;
@@ -385,74 +591,266 @@ mtd_dump(const char *mtd, int part_offset, int size)
 		}
 		if (!rlen || rlen != len)
 			break;
-		if (mtd_block_is_bad(fd, offset)) {
-			fprintf(stderr, "skipping bad block at 0x%08x\n", offset);
-		} else {
-			size -= rlen;
-			write(1, buf, rlen);
+		if (write_full(1, buf, rlen) < 0) {
+			ret = -1;
+			goto out;
 		}
+		size -= rlen;
 		offset += rlen;
-	} while (size > 0);
+	} while (size > 0 && offset < mtdsize);
 
 out:
+	free(buf);
 	close(fd);
 	return ret;
 }
 
+struct verify_hash {
+	md5_ctx_t md5;
+	SHA256_CTX sha256;
+	uint32_t crc;
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+};
+
+static void
+verify_hash_begin(struct verify_hash *h)
+{
+	switch (verify_type) {
+	case VERIFY_MD5:
+		md5_begin(&h->md5);
+		break;
+	case VERIFY_SHA256:
+		SHA256_Init(&h->sha256);
+		break;
+	case VERIFY_CRC32:
+		h->crc = 0xffffffff;
+		break;
+	}
+}
+
+static void
+verify_hash_update(struct verify_hash *h, const void *data, int len)
+{
+	switch (verify_type) {
+	case VERIFY_MD5:
+		md5_hash(data, len, &h->md5);
+		break;
+	case VERIFY_SHA256:
+		SHA256_Update(&h->sha256, data, len);
+		break;
+	case VERIFY_CRC32:
+		h->crc = crc32(h->crc, data, len);
+		break;
+	}
+}
+
+static int
+verify_hash_end(struct verify_hash *h)
+{
+	switch (verify_type) {
+	case VERIFY_MD5:
+		md5_end(h->digest, &h->md5);
+		return 16;
+	case VERIFY_SHA256:
+		SHA256_Final(h->digest, &h->sha256);
+		return SHA256_DIGEST_LENGTH;
+	case VERIFY_CRC32:
+		h->crc = ~h->crc;
+		h->digest[0] = h->crc >> 24;
+		h->digest[1] = h->crc >> 16;
+		h->digest[2] = h->crc >> 8;
+		h->digest[3] = h->crc;
+		return 4;
+	}
+
+	return 0;
+}
+
+static void
+verify_print_hash(struct verify_hash *h, int len, const char *name)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		fprintf(stderr, "%02x", h->digest[i]);
+	fprintf(stderr, " - %s\n", name);
+}
+
+/*
+ * One character per eraseblock: '.' matches, 'X' differs, 'B' bad block
+ * (skipped, like mtd write does) and '+' image data beyond the device end.
+ */
+static void
+verify_print_map(const char *map, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (!(i % 64))
+			fprintf(stderr, "%s0x%08x ", i ? "\n" : "", i * erasesize);
+		fputc(map[i], stderr);
+	}
+	fprintf(stderr, "\n");
+}
+
+static int
+verify_read_image(int imagefd, char *data, int len)
+{
+	int r, n = 0;
+
+	while (n < len) {
+		r = image_read(imagefd, data + n, len - n);
+		if (r < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -1;
+		}
+		if (!r)
+			break;
+		n += r;
+	}
+
+	return n;
+}
+
 static int
 mtd_verify(const char *mtd, char *file)
 {
-	uint32_t f_md5[4], m_md5[4];
-	struct stat s;
-	md5_ctx_t ctx;
-	int ret = 0;
-	int fd;
+	struct verify_hash f_hash, m_hash;
+	char *f_buf = NULL, *m_buf = NULL, *map = NULL;
+	int imagefd = 0, fd, len, rlen, hlen;
+	int ofs = 0, n_blocks = 0, n_bad = 0, n_diff = 0;
+	uint32_t f_crc, m_crc;
+	int ret = -1;
 
 	if (quiet < 2)
 		fprintf(stderr, "Verifying %s against %s ...\n", mtd, file);
 
-	if (stat(file, &s) || md5sum(file, f_md5) < 0) {
-		fprintf(stderr, "Failed to hash %s\n", file);
-		return -1;
+	if (strcmp(file, "-") != 0) {
+		imagefd = open(file, O_RDONLY);
+		if (imagefd < 0) {
+			fprintf(stderr, "Couldn't open image file: %s\n", file);
+			return -1;
+		}
 	}
 
 	fd = mtd_check_open(mtd);
 	if(fd < 0) {
 		fprintf(stderr, "Could not open mtd device: %s\n", mtd);
-		return -1;
+		goto close_image;
 	}
 
-	md5_begin(&ctx);
-	do {
-		char buf[256];
-		int len = (s.st_size > sizeof(buf)) ? (sizeof(buf)) : (s.st_size);
-		int rlen = read(fd, buf, len);
+	f_buf = malloc(erasesize);
+	m_buf = malloc(erasesize);
+	/* one spare entry for data past the end of the device */
+	map = malloc(mtdsize / erasesize + 1);
+	if (!f_buf || !m_buf || !map) {
+		fprintf(stderr, "Out of memory\n");
+		goto out;
+	}
 
-		if (rlen < 0) {
-			if (errno == EINTR)
-				continue;
-			ret = -1;
-			goto out;
+	/* read the image ahead while the flash is being read and hashed */
+	image_reader_start(imagefd);
+
+	verify_hash_begin(&f_hash);
+	verify_hash_begin(&m_hash);
+
+	for (;;) {
+		if (ofs < mtdsize && mtd_block_is_bad(fd, ofs)) {
+			map[n_blocks++] = 'B';
+			ofs += erasesize;
+			n_bad++;
+			continue;
+		}
+
+		len = verify_read_image(imagefd, f_buf, erasesize);
+		if (len < 0) {
+			perror("read");
+			goto stop;
 		}
-		if (!rlen)
+		if (!len)
 			break;
-		md5_hash(buf, rlen, &ctx);
-		s.st_size -= rlen;
-	} while (s.st_size > 0);
 
-	md5_end(m_md5, &ctx);
+		verify_hash_update(&f_hash, f_buf, len);
+
+		if (ofs >= mtdsize) {
+			map[n_blocks++] = '+';
+			n_diff++;
+			/* keep hashing the image, but only account for it once */
+			while ((len = verify_read_image(imagefd, f_buf, erasesize)) > 0)
+				verify_hash_update(&f_hash, f_buf, len);
+			if (len < 0) {
+				perror("read");
+				goto stop;
+			}
+			break;
+		}
+
+		rlen = 0;
+		while (rlen < len) {
+			int r = pread(fd, m_buf + rlen, len - rlen, ofs + rlen);
+
+			if (r < 0 && errno == EINTR)
+				continue;
+			if (r <= 0)
+				break;
+			rlen += r;
+		}
+		if (rlen != len) {
+			fprintf(stderr, "Failed to read %s at 0x%08x\n", mtd, ofs);
+			goto stop;
+		}
+
+		verify_hash_update(&m_hash, m_buf, len);
+
+		if (!memcmp(f_buf, m_buf, len)) {
+			map[n_blocks++] = '.';
+		} else {
+			map[n_blocks++] = 'X';
+			n_diff++;
+
+			if (verify_type == VERIFY_CRC32 && quiet < 2) {
+				m_crc = ~crc32(0xffffffff, m_buf, len);
+				f_crc = ~crc32(0xffffffff, f_buf, len);
+				fprintf(stderr, "0x%08x: %08x - %s, %08x - %s\n",
+					ofs, m_crc, mtd, f_crc, file);
+			}
+		}
+
+		ofs += erasesize;
+	}
+
+	hlen = verify_hash_end(&m_hash);
+	verify_hash_end(&f_hash);
 
-	fprintf(stderr, "%08x%08x%08x%08x - %s\n", m_md5[0], m_md5[1], m_md5[2], m_md5[3], mtd);
-	fprintf(stderr, "%08x%08x%08x%08x - %s\n", f_md5[0], f_md5[1], f_md5[2], f_md5[3], file);
+	verify_print_hash(&m_hash, hlen, mtd);
+	verify_print_hash(&f_hash, hlen, file);
 
-	ret = memcmp(f_md5, m_md5, sizeof(m_md5));
+	if (n_bad && quiet < 2)
+		fprintf(stderr, "Skipped %d bad block(s)\n", n_bad);
+
+	if (n_diff && quiet < 2) {
+		fprintf(stderr, "%d of %d block(s) differ:\n",
+			n_diff, n_blocks - n_bad);
+		verify_print_map(map, n_blocks);
+	}
+
+	ret = n_diff;
 	if (!ret)
 		fprintf(stderr, "Success\n");
 	else
 		fprintf(stderr, "Failed\n");
 
+stop:
+	image_reader_stop();
 out:
+	free(map);
+	free(m_buf);
+	free(f_buf);
 	close(fd);
+close_image:
+	if (imagefd)
+		close(imagefd);
 	return ret;
 }
 
@@ -478,6 +876,8 @@ mtd_write(int imagefd, const char *mtd, char *fis_layout, size_t part_offset)
 	int buflen_raw = 0;
 	int jffs2_replaced = 0;
 	int skip_bad_blocks = 0;
+	int unchanged, n_written = 0, n_skipped = 0;
+	uint64_t t, flash_time = 0, cmp_time = 0;
 
 #ifdef FIS_SUPPORT
 	static struct fis_part new_parts[MAX_ARGS];
@@ -543,6 +943,7 @@ next:
 	}
 
 	r = 0;
+	image_reader_start(imagefd);
 
 resume:
 	next = strchr(mtd, ':');
@@ -578,7 +979,7 @@ resume:
 	for (;;) {
 		/* buffer may contain data already (from trx check or last mtd partition write attempt) */
 		while (buflen < erasesize) {
-			r = read(imagefd, buf + buflen, erasesize - buflen);
+			r = image_read(imagefd, buf + buflen, erasesize - buflen);
 			if (r < 0) {
 				if ((errno == EINTR) || (errno == EAGAIN))
 					continue;
@@ -642,8 +1043,26 @@ resume:
 			mtd_parse_jffs2data(buf, jffs2dir);
 		}
 
+		/*
+		 * in differential mode, leave eraseblocks alone which already hold
+		 * the data. Only whole, good blocks that have not been erased yet
+		 * are candidates.
+		 */
+		unchanged = 0;
+		if (differential && !no_erase && !offset && w == e - skip_bad_blocks) {
+			if (!quiet)
+				fprintf(stderr, "\b\b\b[c]");
+
+			t = time_us();
+			unchanged = !mtd_block_is_bad(fd, e) &&
+				    mtd_block_unchanged(fd, e + part_offset, buf);
+			cmp_time += time_us() - t;
+		}
+
+		t = time_us();
+
 		/* need to erase the next block before writing data to it */
-		if(!no_erase)
+		if(!no_erase && !unchanged)
 		{
 			while (w + buflen > e - skip_bad_blocks) {
 				if (!quiet)
@@ -684,17 +1103,26 @@ resume:
 			}
 		}
 
-		if (!quiet)
-			fprintf(stderr, "\b\b\b[w]");
-
-		if ((result = write(fd, buf + offset, buflen)) < buflen) {
-			if (result < 0) {
-				fprintf(stderr, "Error writing image.\n");
-				exit(1);
-			} else {
-				fprintf(stderr, "Insufficient space.\n");
-				exit(1);
+		if (unchanged) {
+			/* move the file pointer along over the block */
+			lseek(fd, buflen, SEEK_CUR);
+			e += erasesize;
+			n_skipped++;
+		} else {
+			if (!quiet)
+				fprintf(stderr, "\b\b\b[w]");
+
+			if ((result = write(fd, buf + offset, buflen)) < buflen) {
+				if (result < 0) {
+					fprintf(stderr, "Error writing image.\n");
+					exit(1);
+				} else {
+					fprintf(stderr, "Insufficient space.\n");
+					exit(1);
+				}
 			}
+			flash_time += time_us() - t;
+			n_written++;
 		}
 		w += buflen;
 
@@ -713,6 +1141,8 @@ resume:
 		offset = 0;
 	}
 
+	image_reader_stop();
+
 	if (jffs2_replaced) {
 		switch (imageformat) {
 		case MTD_IMAGE_FORMAT_TRX:
@@ -742,6 +1172,17 @@ resume:
 	if (quiet < 2)
 		fprintf(stderr, "\n");
 
+	if (differential && quiet < 2) {
+		fprintf(stderr, "%d of %d blocks unchanged and skipped",
+			n_skipped, n_skipped + n_written);
+		/* estimate based on the average erase/write time of the others */
+		if (n_skipped && n_written)
+			fprintf(stderr, ", saved ~%llu ms",
+				(unsigned long long) (flash_time / n_written * n_skipped / 1000));
+		fprintf(stderr, " (%llu ms spent comparing)\n",
+			(unsigned long long) (cmp_time / 1000));
+	}
+
 #ifdef FIS_SUPPORT
 	if (fis_layout) {
 		if (fis_remap(old_parts, n_old, new_parts, n_new) < 0)
@@ -801,6 +1242,8 @@ static void usage(void)
 	"        -q                      quiet mode (once: no [w] on writing,\n"
 	"                                           twice: no status messages)\n"
 	"        -n                      write without first erasing the blocks\n"
+	"        -D                      differential write: skip erasing/writing blocks\n"
+	"                                which already contain the data to be written\n"
 	"        -r                      reboot after successful command\n"
 	"        -f                      force write without trx checks\n"
 	"        -e <device>             erase <device> before executing the command\n"
@@ -808,7 +1251,9 @@ static void usage(void)
 	"        -j <name>               integrate <file> into jffs2 data when writing an image\n"
 	"        -s <number>             skip the first n bytes when appending data to the jffs2 partiton, defaults to \"0\"\n"
 	"        -p <number>             write beginning at partition offset\n"
-	"        -l <length>             the length of data that we want to dump\n");
+	"        -l <length>             the length of data that we want to dump\n"
+	"        -H <md5|sha256|crc32>   checksum used by verify, defaults to md5\n"
+	"                                (crc32 also prints checksums of differing blocks)\n");
 	if (mtd_fixtrx) {
 	    fprintf(stderr,
 	"        -M <magic>              magic number of the image header in the partition (for fixtrx)\n"
@@ -879,7 +1324,7 @@ int main (int argc, char **argv)
 #ifdef FIS_SUPPORT
 			"F:"
 #endif
-			"frnqe:d:s:j:p:o:c:t:l:M:")) != -1)
+			"frnDqe:d:s:j:p:o:c:t:l:M:H:")) != -1)
 		switch (ch) {
 			case 'f':
 				force = 1;
@@ -890,6 +1335,21 @@ int main (int argc, char **argv)
 			case 'n':
 				no_erase = 1;
 				break;
+			case 'D':
+				differential = 1;
+				break;
+			case 'H':
+				if (!strcmp(optarg, "md5"))
+					verify_type = VERIFY_MD5;
+				else if (!strcmp(optarg, "sha256"))
+					verify_type = VERIFY_SHA256;
+				else if (!strcmp(optarg, "crc32"))
+					verify_type = VERIFY_CRC32;
+				else {
+					fprintf(stderr, "-H: unknown checksum type\n");
+					usage();
+				}
+				break;
 			case 'j':
 				jffs2file = optarg;
 				break;
@@ -38,7 +38,7 @@
 #include <mtd/mtd-user.h>
 #include "mtd.h"
 #include "seama.h"
-#include "md5.h"
+#include "fixup.h"
 
 #if __BYTE_ORDER == __BIG_ENDIAN
 #define STORE32_LE(X)           ((((X) & 0x000000FF) << 24) | (((X) & 0x0000FF00) << 8) | (((X) & 0x00FF0000) >> 8) | (((X) & 0xFF000000) >> 24))
@@ -54,31 +54,17 @@ ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
 int
 seama_fix_md5(struct seama_entity_header *shdr, int fd, size_t data_offset, size_t data_size)
 {
-	char *buf;
-	ssize_t res;
-	MD5_CTX ctx;
-	unsigned char digest[16];
+	struct fixup_sum sum;
 	int i;
-	int err = 0;
+	int err;
 
-	buf = malloc(data_size);
-	if (!buf) {
-		err = -ENOMEM;
-		goto err_out;
-	}
+	fixup_sum_init(&sum, FIXUP_MD5);
+	err = fixup_sum_read(&sum, fd, data_offset, data_size, false);
+	if (err)
+		return err;
+	fixup_sum_final(&sum);
 
-	res = pread(fd, buf, data_size, data_offset);
-	if (res != data_size) {
-		perror("pread");
-		err = -EIO;
-		goto err_free;
-	}
-
-	MD5_Init(&ctx);
-	MD5_Update(&ctx, buf, data_size);
-	MD5_Final(digest, &ctx);
-
-	if (!memcmp(digest, shdr->md5, sizeof(digest))) {
+	if (!memcmp(sum.digest, shdr->md5, sizeof(sum.digest))) {
 		if (quiet < 2)
 			fprintf(stderr, "the header is fixed already\n");
 		return -1;
@@ -86,8 +72,8 @@ seama_fix_md5(struct seama_entity_header *shdr, int fd, size_t data_offset, size
 
 	if (quiet < 2) {
 		fprintf(stderr, "new size:%u, new MD5: ", data_size);
-		for (i = 0; i < sizeof(digest); i++)
-			fprintf(stderr, "%02x", digest[i]);
+		for (i = 0; i < sizeof(sum.digest); i++)
+			fprintf(stderr, "%02x", sum.digest[i]);
 
 		fprintf(stderr, "\n");
 	}
@@ -96,12 +82,9 @@ seama_fix_md5(struct seama_entity_header *shdr, int fd, size_t data_offset, size
 	shdr->size = htonl(data_size);
 
 	/* update the checksum in the image */
-	memcpy(shdr->md5, digest, sizeof(digest));
+	memcpy(shdr->md5, sum.digest, sizeof(sum.digest));
 
-err_free:
-	free(buf);
-err_out:
-	return err;
+	return 0;
 }
 
 int
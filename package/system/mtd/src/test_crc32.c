@@ -0,0 +1,150 @@
+/*
+ * test_crc32.c
+ *
+ * Host test and benchmark for crc32(), run with "make test". Checks the
+ * fast path (slice-by-8, or the ARMv8 CRC32 instructions) against a
+ * bytewise reference and prints the throughput of both.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "crc32.h"
+
+#define BENCH_SIZE	(4 * 1024 * 1024)
+#define BENCH_RUNS	10
+
+/* bitwise, so that it does not share crc32_table with the code under test */
+static uint32_t
+ref_crc32(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	int k;
+
+	while (len--) {
+		crc ^= *buf++;
+		for (k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return crc;
+}
+
+/* the loop crc32() used before slice-by-8 */
+static uint32_t
+bytewise_crc32(uint32_t crc, const unsigned char *buf, int len)
+{
+	while (--len >= 0)
+		crc = crc32_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+bench(uint32_t (*fn)(uint32_t, const void *, int), const unsigned char *buf,
+      uint32_t *crc)
+{
+	double best = 0, t;
+	int i;
+
+	for (i = 0; i < BENCH_RUNS; i++) {
+		t = now();
+		*crc = fn(0xFFFFFFFF, buf, BENCH_SIZE);
+		t = now() - t;
+		if (!i || t < best)
+			best = t;
+	}
+
+	return BENCH_SIZE / best / 1e6;
+}
+
+static uint32_t
+bench_bytewise(uint32_t crc, const void *buf, int len)
+{
+	return bytewise_crc32(crc, buf, len);
+}
+
+int
+main(int argc, char **argv)
+{
+	static unsigned char buf[BENCH_SIZE];
+	uint32_t crc, ref, fast_crc, slow_crc;
+	double fast, slow;
+	int ret = 0;
+	int off, len, split;
+
+	crc = ~crc32(0xFFFFFFFF, "123456789", 9);
+	if (crc != 0xCBF43926) {
+		fprintf(stderr, "FAIL: check value %08x\n", crc);
+		ret = 1;
+	}
+
+	srand(1);
+	for (len = 0; len < BENCH_SIZE; len++)
+		buf[len] = rand();
+
+	/* every alignment with every tail length, and a few longer buffers */
+	for (off = 0; off < 16; off++) {
+		for (len = 0; len < 300; len++) {
+			crc = crc32(0xFFFFFFFF, buf + off, len);
+			ref = ref_crc32(0xFFFFFFFF, buf + off, len);
+			if (crc != ref) {
+				fprintf(stderr, "FAIL: offset %d length %d: %08x/%08x\n",
+					off, len, crc, ref);
+				ret = 1;
+			}
+		}
+	}
+
+	for (len = 1000; len < 70000; len = len * 3 + 7) {
+		off = rand() % 4096;
+		crc = crc32(0xFFFFFFFF, buf + off, len);
+		ref = ref_crc32(0xFFFFFFFF, buf + off, len);
+		if (crc != ref) {
+			fprintf(stderr, "FAIL: offset %d length %d: %08x/%08x\n",
+				off, len, crc, ref);
+			ret = 1;
+		}
+
+		/* callers feed data in chunks, e.g. fixup_sum_update() */
+		split = rand() % len;
+		crc = crc32(crc32(0xFFFFFFFF, buf + off, split),
+			    buf + off + split, len - split);
+		if (crc != ref) {
+			fprintf(stderr, "FAIL: length %d split at %d: %08x/%08x\n",
+				len, split, crc, ref);
+			ret = 1;
+		}
+	}
+
+	fast = bench(crc32, buf, &fast_crc);
+	slow = bench(bench_bytewise, buf, &slow_crc);
+	if (fast_crc != slow_crc) {
+		fprintf(stderr, "FAIL: %d bytes: %08x/%08x\n", BENCH_SIZE,
+			fast_crc, slow_crc);
+		ret = 1;
+	}
+
+	printf("test_crc32: crc32() %.1f MB/s, bytewise %.1f MB/s\n", fast, slow);
+	if (!ret)
+		printf("test_crc32: all tests passed\n");
+
+	return ret;
+}
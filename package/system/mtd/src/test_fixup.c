@@ -0,0 +1,153 @@
+/*
+ * test_fixup.c
+ *
+ * Host test for the shared checksum pass of the image header fixups,
+ * run with "make test".
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mtd.h"
+#include "crc32.h"
+#include "fixup.h"
+
+/* 64k blocks, the image spans several read chunks and ends mid block */
+#define TEST_ERASESIZE	(64 * 1024)
+#define TEST_SIZE	(11 * TEST_ERASESIZE + 1234)
+
+int erasesize = TEST_ERASESIZE;
+static int bad_block = -1;
+
+int
+mtd_block_is_bad(int fd, int offset)
+{
+	return offset == bad_block;
+}
+
+/* bytewise reference, independent of the crc32() fast path */
+static uint32_t
+ref_crc32(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	while (len--)
+		crc = crc32_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static void
+ref_md5(unsigned char *digest, const unsigned char *buf, size_t len)
+{
+	MD5_CTX ctx;
+
+	MD5_Init(&ctx);
+	MD5_Update(&ctx, buf, len);
+	MD5_Final(digest, &ctx);
+}
+
+static int
+check(const char *name, int fd, const unsigned char *data, size_t offset,
+      size_t len, bool skip_bad)
+{
+	static unsigned char expect[TEST_SIZE];
+	unsigned char digest[16];
+	struct fixup_sum s;
+	size_t i, n = 0;
+	uint32_t crc;
+
+	/* what the fixup must see: the range, minus any bad block */
+	for (i = offset; i < offset + len; i++) {
+		if (skip_bad && bad_block >= 0 &&
+		    (i & ~(TEST_ERASESIZE - 1)) == bad_block)
+			continue;
+		expect[n++] = data[i];
+	}
+	crc = ref_crc32(0xFFFFFFFF, expect, n);
+	ref_md5(digest, expect, n);
+
+	fixup_sum_init(&s, FIXUP_CRC32 | FIXUP_MD5);
+	if (fixup_sum_read(&s, fd, offset, len, skip_bad)) {
+		fprintf(stderr, "FAIL: %s: read error\n", name);
+		return 1;
+	}
+	fixup_sum_final(&s);
+
+	if (s.len != n || s.crc != crc || memcmp(s.digest, digest, 16)) {
+		fprintf(stderr, "FAIL: %s: len %zu/%zu crc %08x/%08x\n",
+			name, s.len, n, s.crc, crc);
+		return 1;
+	}
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	static unsigned char data[TEST_SIZE];
+	unsigned char digest[16];
+	char name[] = "/tmp/test_fixup.XXXXXX";
+	struct fixup_sum s;
+	int fd, i, ret = 0;
+
+	srand(1);
+	for (i = 0; i < TEST_SIZE; i++)
+		data[i] = rand();
+
+	fd = mkstemp(name);
+	if (fd < 0 || write(fd, data, TEST_SIZE) != TEST_SIZE) {
+		perror("test file");
+		return 1;
+	}
+	unlink(name);
+
+	ret |= check("whole image", fd, data, 0, TEST_SIZE, false);
+	ret |= check("unaligned range", fd, data, 28, TEST_SIZE - 100, false);
+	ret |= check("empty range", fd, data, 100, 0, false);
+	ret |= check("no bad blocks", fd, data, 28, TEST_SIZE - 28, true);
+
+	bad_block = 3 * TEST_ERASESIZE;
+	ret |= check("bad block skipped", fd, data, 28, TEST_SIZE - 28, true);
+	ret |= check("bad block read", fd, data, 28, TEST_SIZE - 28, false);
+	ret |= check("start in bad block", fd, data, bad_block + 100,
+		     2 * TEST_ERASESIZE, true);
+
+	bad_block = 0;
+	ret |= check("first block bad", fd, data, 28, TEST_SIZE - 28, true);
+
+	/* header fields fed in front of the device data, as wrg/wrgg do */
+	fixup_sum_init(&s, FIXUP_MD5);
+	fixup_sum_update(&s, data, 16);
+	fixup_sum_read(&s, fd, 16, TEST_SIZE - 16, false);
+	fixup_sum_final(&s);
+	ref_md5(digest, data, TEST_SIZE);
+	if (memcmp(s.digest, digest, 16)) {
+		fprintf(stderr, "FAIL: update before read\n");
+		ret = 1;
+	}
+
+	/* the read error path */
+	fixup_sum_init(&s, FIXUP_CRC32);
+	if (!fixup_sum_read(&s, fd, TEST_SIZE - 10, 20, false)) {
+		fprintf(stderr, "FAIL: short read not reported\n");
+		ret = 1;
+	}
+
+	close(fd);
+
+	if (!ret)
+		printf("test_fixup: all tests passed\n");
+
+	return ret;
+}
@@ -34,7 +34,7 @@
 #include <sys/ioctl.h>
 #include <mtd/mtd-user.h>
 #include "mtd.h"
-#include "crc32.h"
+#include "fixup.h"
 
 #define TRX_CRC32_DATA_OFFSET	12	/* First 12 bytes are not covered by CRC32 */
 #define TRX_CRC32_DATA_SIZE	16
@@ -46,12 +46,6 @@ struct trx_header {
 	uint32_t offsets[3];    /* Offsets of partitions from start of header */
 };
 
-#define min(x,y) ({		\
-	typeof(x) _x = (x);	\
-	typeof(y) _y = (y);	\
-	(void) (&_x == &_y);	\
-	_x < _y ? _x : _y; })
-
 #if __BYTE_ORDER == __BIG_ENDIAN
 #define STORE32_LE(X)           ((((X) & 0x000000FF) << 24) | (((X) & 0x0000FF00) << 8) | (((X) & 0x00FF0000) >> 8) | (((X) & 0xFF000000) >> 24))
 #elif __BYTE_ORDER == __LITTLE_ENDIAN
@@ -69,7 +63,8 @@ trx_fixup(int fd, const char *name)
 	struct mtd_info_user mtdInfo;
 	unsigned long len;
 	struct trx_header *trx;
-	void *ptr, *scan;
+	struct fixup_sum sum;
+	void *ptr;
 	int bfd;
 
 	if (ioctl(fd, MEMGETINFO, &mtdInfo) < 0) {
@@ -97,8 +92,15 @@ trx_fixup(int fd, const char *name)
 		goto err;
 	}
 
-	scan = ptr + offsetof(struct trx_header, flag_version);
-	trx->crc32 = crc32buf(scan, trx->len - (scan - ptr));
+	fixup_sum_init(&sum, FIXUP_CRC32);
+	if (fixup_sum_read(&sum, bfd, offsetof(struct trx_header, flag_version),
+			   trx->len - offsetof(struct trx_header, flag_version),
+			   false)) {
+		munmap(ptr, len);
+		goto err1;
+	}
+
+	trx->crc32 = sum.crc;
 	msync(ptr, sizeof(struct trx_header), MS_SYNC|MS_INVALIDATE);
 	munmap(ptr, len);
 	close(bfd);
@@ -160,8 +162,8 @@ mtd_fixtrx(const char *mtd, size_t offset, size_t data_size)
 	size_t data_offset;
 	int fd;
 	struct trx_header *trx;
+	struct fixup_sum sum;
 	char *first_block;
-	char *buf, *to;
 	ssize_t res;
 	size_t block_offset;
 
@@ -206,37 +208,14 @@ mtd_fixtrx(const char *mtd, size_t offset, size_t data_size)
 		exit(1);
 	}
 
-	buf = malloc(data_size);
-	if (!buf) {
-		perror("malloc");
+	/* Read from good blocks only to match CFE behavior */
+	fixup_sum_init(&sum, FIXUP_CRC32);
+	if (fixup_sum_read(&sum, fd, data_offset, data_size, true))
 		exit(1);
-	}
-
-	to = buf;
-	while (data_size) {
-		size_t read_block_offset = data_offset & ~(erasesize - 1);
-		size_t read_chunk;
-
-		read_chunk = erasesize - (data_offset & (erasesize - 1));
-		read_chunk = min(read_chunk, data_size);
-
-		/* Read from good blocks only to match CFE behavior */
-		if (!mtd_block_is_bad(fd, read_block_offset)) {
-			res = pread(fd, to, read_chunk, data_offset);
-			if (res != read_chunk) {
-				perror("pread");
-				exit(1);
-			}
-			to += read_chunk;
-		}
-
-		data_offset += read_chunk;
-		data_size -= read_chunk;
-	}
-	data_size = to - buf;
+	data_size = sum.len;
 
 	if (trx->len == STORE32_LE(data_size + TRX_CRC32_DATA_OFFSET) &&
-	    trx->crc32 == STORE32_LE(crc32buf(buf, data_size))) {
+	    trx->crc32 == STORE32_LE(sum.crc)) {
 		if (quiet < 2)
 			fprintf(stderr, "Header already fixed, exiting\n");
 		close(fd);
@@ -245,7 +224,7 @@ mtd_fixtrx(const char *mtd, size_t offset, size_t data_size)
 
 	trx->len = STORE32_LE(data_size + offsetof(struct trx_header, flag_version));
 
-	trx->crc32 = STORE32_LE(crc32buf(buf, data_size));
+	trx->crc32 = STORE32_LE(sum.crc);
 	if (mtd_erase_block(fd, block_offset)) {
 		fprintf(stderr, "Can't erease block at 0x%zx (%s)\n", block_offset, strerror(errno));
 		exit(1);
@@ -37,7 +37,7 @@
 #include <mtd/mtd-user.h>
 #include "mtd.h"
 #include "wrgg.h"
-#include "md5.h"
+#include "fixup.h"
 
 static inline uint32_t le32_to_cpu(uint8_t *buf)
 {
@@ -50,33 +50,19 @@ ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
 int
 wrgg_fix_md5(struct wrgg03_header *shdr, int fd, size_t data_offset, size_t data_size)
 {
-	char *buf;
-	ssize_t res;
-	MD5_CTX ctx;
-	unsigned char digest[16];
+	struct fixup_sum sum;
 	int i;
-	int err = 0;
+	int err;
 
-	buf = malloc(data_size);
-	if (!buf) {
-		err = -ENOMEM;
-		goto err_out;
-	}
+	fixup_sum_init(&sum, FIXUP_MD5);
+	fixup_sum_update(&sum, (char *)&shdr->offset, sizeof(shdr->offset));
+	fixup_sum_update(&sum, (char *)&shdr->dev_name, sizeof(shdr->dev_name));
+	err = fixup_sum_read(&sum, fd, data_offset, data_size, false);
+	if (err)
+		return err;
+	fixup_sum_final(&sum);
 
-	res = pread(fd, buf, data_size, data_offset);
-	if (res != data_size) {
-		perror("pread");
-		err = -EIO;
-		goto err_free;
-	}
-
-	MD5_Init(&ctx);
-	MD5_Update(&ctx, (char *)&shdr->offset, sizeof(shdr->offset));
-	MD5_Update(&ctx, (char *)&shdr->dev_name, sizeof(shdr->dev_name));
-	MD5_Update(&ctx, buf, data_size);
-	MD5_Final(digest, &ctx);
-
-	if (!memcmp(digest, shdr->digest, sizeof(digest))) {
+	if (!memcmp(sum.digest, shdr->digest, sizeof(sum.digest))) {
 		if (quiet < 2)
 			fprintf(stderr, "the header is fixed already\n");
 		return -1;
@@ -84,8 +70,8 @@ wrgg_fix_md5(struct wrgg03_header *shdr, int fd, size_t data_offset, size_t data
 
 	if (quiet < 2) {
 		fprintf(stderr, "new size:%u, new MD5: ", data_size);
-		for (i = 0; i < sizeof(digest); i++)
-			fprintf(stderr, "%02x", digest[i]);
+		for (i = 0; i < sizeof(sum.digest); i++)
+			fprintf(stderr, "%02x", sum.digest[i]);
 
 		fprintf(stderr, "\n");
 	}
@@ -94,12 +80,9 @@ wrgg_fix_md5(struct wrgg03_header *shdr, int fd, size_t data_offset, size_t data
 	shdr->size = data_size;
 
 	/* update the checksum in the image */
-	memcpy(shdr->digest, digest, sizeof(digest));
+	memcpy(shdr->digest, sum.digest, sizeof(sum.digest));
 
-err_free:
-	free(buf);
-err_out:
-	return err;
+	return 0;
 }
 
 int
@@ -129,6 +129,15 @@ struct symbol {
 	 * "Weak" reverse dependencies through being implied by other symbols
 	 */
 	struct expr_value implied;
+
+	/*
+	 * Symbols whose value or visibility is calculated from this symbol,
+	 * built on first use by sym_invalidate(). 'dependents_gen' marks the
+	 * symbol as visited during the current invalidation pass.
+	 */
+	struct symbol **dependents;
+	int dependents_cnt;
+	unsigned int dependents_gen;
 };
 
 #define for_all_symbols(i, sym) for (i = 0; i < SYMBOL_HASHSIZE; i++) for (sym = symbol_hash[i]; sym; sym = sym->next)
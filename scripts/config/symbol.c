@@ -454,6 +454,150 @@ void sym_clear_all_valid(void)
 	sym_calc_value(modules_sym);
 }
 
+static bool sym_dependents_built;
+
+static void sym_add_dependent(struct symbol *sym, struct symbol *dep)
+{
+	int cnt;
+
+	if (!sym || sym == dep || sym->flags & SYMBOL_CONST)
+		return;
+
+	cnt = sym->dependents_cnt;
+	if (cnt && sym->dependents[cnt - 1] == dep)
+		return;
+
+	/* grow in powers of two */
+	if (!(cnt & (cnt - 1)))
+		sym->dependents = xrealloc(sym->dependents,
+					   (cnt ? cnt * 2 : 1) * sizeof(dep));
+	sym->dependents[sym->dependents_cnt++] = dep;
+}
+
+static void expr_add_dependents(struct expr *e, struct symbol *dep)
+{
+	if (!e)
+		return;
+
+	switch (e->type) {
+	case E_OR:
+	case E_AND:
+		expr_add_dependents(e->left.expr, dep);
+		expr_add_dependents(e->right.expr, dep);
+		break;
+	case E_NOT:
+		expr_add_dependents(e->left.expr, dep);
+		break;
+	case E_LIST:
+		for (; e; e = e->left.expr)
+			sym_add_dependent(e->right.sym, dep);
+		break;
+	case E_SYMBOL:
+		sym_add_dependent(e->left.sym, dep);
+		break;
+	case E_EQUAL:
+	case E_GEQ:
+	case E_GTH:
+	case E_LEQ:
+	case E_LTH:
+	case E_UNEQUAL:
+	case E_RANGE:
+		sym_add_dependent(e->left.sym, dep);
+		sym_add_dependent(e->right.sym, dep);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Record for every symbol which other symbols reference it, through
+ * dependencies, selects, implies, prompts, defaults and ranges. The choice
+ * properties link a choice and its values in both directions.
+ */
+static void sym_build_dependents(void)
+{
+	struct symbol *sym;
+	struct property *prop;
+	int i;
+
+	for_all_symbols(i, sym) {
+		expr_add_dependents(sym->dir_dep.expr, sym);
+		expr_add_dependents(sym->rev_dep.expr, sym);
+		expr_add_dependents(sym->implied.expr, sym);
+		for (prop = sym->prop; prop; prop = prop->next) {
+			expr_add_dependents(prop->expr, sym);
+			expr_add_dependents(prop->visible.expr, sym);
+		}
+	}
+	sym_dependents_built = true;
+}
+
+/*
+ * Invalidate the value of 'sym' and of all symbols depending on it, directly
+ * or indirectly, instead of recalculating the whole symbol table. A change of
+ * the modules symbol affects every tristate, so fall back to
+ * sym_clear_all_valid() in that case.
+ *
+ * This only covers changes of single values, as done by the front ends and
+ * the oldconfig questions. conf_read() replaces all user values at once and
+ * conf_reset() already invalidates every symbol, so loading a config file
+ * is a single full recalculation either way.
+ */
+static void sym_invalidate(struct symbol *sym)
+{
+	static struct symbol **stack;
+	static int stack_size;
+	static unsigned int gen;
+	tristate old_modules_val = modules_val;
+	struct symbol *cur;
+	int i, n = 0;
+
+	if (sym == modules_sym) {
+		sym_clear_all_valid();
+		return;
+	}
+
+	if (!sym_dependents_built)
+		sym_build_dependents();
+
+	/*
+	 * Walk the whole subgraph rather than stopping at symbols which are
+	 * already invalid: values are calculated lazily, so a valid symbol
+	 * may depend on one that has not been recalculated yet.
+	 */
+	gen++;
+	sym->dependents_gen = gen;
+	stack_size = stack_size ? stack_size : 64;
+	if (!stack)
+		stack = xmalloc(stack_size * sizeof(*stack));
+	stack[n++] = sym;
+
+	while (n) {
+		cur = stack[--n];
+		cur->flags &= ~SYMBOL_VALID;
+
+		for (i = 0; i < cur->dependents_cnt; i++) {
+			struct symbol *dep = cur->dependents[i];
+
+			if (dep->dependents_gen == gen)
+				continue;
+
+			dep->dependents_gen = gen;
+			if (n == stack_size) {
+				stack_size *= 2;
+				stack = xrealloc(stack, stack_size * sizeof(*stack));
+			}
+			stack[n++] = dep;
+		}
+	}
+
+	conf_set_changed(true);
+	sym_calc_value(modules_sym);
+	if (modules_val != old_modules_val)
+		sym_clear_all_valid();
+}
+
 bool sym_tristate_within_range(struct symbol *sym, tristate val)
 {
 	int type = sym_get_type(sym);
@@ -504,7 +648,7 @@ bool sym_set_tristate_value(struct symbol *sym, tristate val)
 
 	sym->def[S_DEF_USER].tri = val;
 	if (oldval != val)
-		sym_clear_all_valid();
+		sym_invalidate(sym);
 
 	return true;
 }
@@ -661,7 +805,7 @@ bool sym_set_string_value(struct symbol *sym, const char *newval)
 
 	strcpy(val, newval);
 	free((void *)oldval);
-	sym_clear_all_valid();
+	sym_invalidate(sym);
 
 	return true;
 }
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * lzma-loader-bench - time the decoder of an lzma-loader on the host
+ *
+ * Built by scripts/lzma-loader-bench.sh against the LzmaDecode.c of a
+ * loader. Decodes a kernel payload the same way the loader does, in one
+ * call from a memory buffer into a memory buffer, and prints the best
+ * throughput of a number of runs together with a checksum of the output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "LzmaDecode.h"
+
+/* lc/lp/pb, dictionary size and uncompressed size */
+#define LZMA_HDR_SIZE	(LZMA_PROPERTIES_SIZE + 8)
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned char *read_file(const char *name, size_t *size)
+{
+	unsigned char *buf = NULL;
+	size_t len = 0, n;
+	FILE *f;
+
+	f = fopen(name, "rb");
+	if (!f)
+		return NULL;
+
+	do {
+		buf = realloc(buf, len + 65536);
+		if (!buf)
+			break;
+		n = fread(buf + len, 1, 65536, f);
+		len += n;
+	} while (n == 65536);
+
+	fclose(f);
+	*size = len;
+	return buf;
+}
+
+int main(int argc, char **argv)
+{
+	CLzmaDecoderState state;
+	unsigned char *in, *out;
+	SizeT ip, op, outsize = 0;
+	double best = 0, t;
+	unsigned int sum = 0;
+	size_t insize;
+	int runs = 10;
+	int i, ret;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <payload.lzma> [<runs>]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		runs = atoi(argv[2]);
+
+	in = read_file(argv[1], &insize);
+	if (!in || insize < LZMA_HDR_SIZE) {
+		fprintf(stderr, "failed to read %s\n", argv[1]);
+		return 1;
+	}
+
+	if (LzmaDecodeProperties(&state.Properties, in,
+				 LZMA_PROPERTIES_SIZE) != LZMA_RESULT_OK) {
+		fprintf(stderr, "invalid lzma properties\n");
+		return 1;
+	}
+
+	/* the loaders only look at the low 32 bits of the size */
+	for (i = 0; i < 4; i++)
+		outsize |= (SizeT)in[LZMA_PROPERTIES_SIZE + i] << (i * 8);
+
+	out = malloc(outsize);
+	state.Probs = malloc(LzmaGetNumProbs(&state.Properties) *
+			     sizeof(CProb));
+	if (!out || !state.Probs) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for (i = 0; i < runs; i++) {
+		t = now();
+		ret = LzmaDecode(&state, in + LZMA_HDR_SIZE,
+				 insize - LZMA_HDR_SIZE, &ip, out, outsize, &op);
+		t = now() - t;
+		if (ret != LZMA_RESULT_OK || op != outsize) {
+			fprintf(stderr, "decode error %d, %lu of %lu bytes\n",
+				ret, (unsigned long)op, (unsigned long)outsize);
+			return 1;
+		}
+		if (!i || t < best)
+			best = t;
+	}
+
+	for (op = 0; op < outsize; op++)
+		sum = sum * 31 + out[op];
+
+	printf("%lu -> %lu bytes, %.3f s, %.1f MB/s, sum %08x\n",
+	       (unsigned long)insize, (unsigned long)outsize, best,
+	       outsize / best / 1e6, sum);
+
+	return 0;
+}
@@ -0,0 +1,46 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-only
+#
+### lzma-loader-bench - time lzma-loader decoders on the host
+###
+### Builds the LzmaDecode.c of one or more lzma-loader source directories
+### natively, with the loader's -Os/_LZMA_PROB32 settings, and decodes a
+### kernel payload with each of them. The payload is what the loader gets
+### as LOADER_DATA, the kernel after the lzma image build step. It can be
+### recreated from the kernel of a target build with:
+###
+###   staging_dir/host/bin/lzma e vmlinux vmlinux.lzma -lc1 -lp2 -pb2
+###
+### Decoding is done in one call, as in the ath79, bmips, lantiq and ramips
+### loaders. The checksum of the output must match between decoders.
+###
+### Usage:
+###   ./scripts/lzma-loader-bench.sh <payload.lzma> <loader src dir>...
+###
+### Environment:
+###   CC      host compiler (default: cc)
+###   CFLAGS  compiler flags (default: -Os -D_LZMA_PROB32)
+###   RUNS    number of runs, the fastest one is reported (default: 10)
+
+[ $# -ge 2 ] || {
+	sed -n 's/^### \{0,1\}//p' "$0" >&2
+	exit 1
+}
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+CC="${CC:-cc}"
+CFLAGS="${CFLAGS:--Os -D_LZMA_PROB32}"
+RUNS="${RUNS:-10}"
+
+payload="$1"
+shift
+
+tmp="$(mktemp -d)" || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+for src in "$@"; do
+	$CC $CFLAGS -I"$src" -o "$tmp/bench" \
+		"$SCRIPT_DIR/lzma-loader-bench.c" "$src/LzmaDecode.c" || exit 1
+	printf '%s: ' "$src"
+	"$tmp/bench" "$payload" "$RUNS" || exit 1
+done
@@ -86,11 +86,21 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ >= 5)
+#define HAVE_SHA_NI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 #define ARRAY_SIZE(_n) (sizeof(_n) / sizeof((_n)[0]))
 
@@ -451,6 +461,26 @@ be32dec_vect(uint32_t *dst, const unsigned char *src, size_t len)
 #define Maj(x, y, z)	((x & (y | z)) | (y & z))
 #define ROTR(x, n)	((x >> n) | (x << (32 - n)))
 
+/* SHA256 round constants. */
+static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
 /*
  * SHA256 block compression function.  The 256-bit state is transformed via
  * the 512-bit input block to produce a new state.
@@ -458,25 +488,6 @@ be32dec_vect(uint32_t *dst, const unsigned char *src, size_t len)
 static void
 SHA256_Transform(uint32_t * state, const unsigned char block[64])
 {
-	/* SHA256 round constants. */
-	static const uint32_t K[64] = {
-		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
-		0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
-		0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
-		0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
-		0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
-		0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
-		0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
-		0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-		0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
-	};
 	uint32_t W[64];
 	uint32_t S[8];
 	int i;
@@ -562,6 +573,105 @@ SHA256_Transform(uint32_t * state, const unsigned char block[64])
 		state[i] += S[i];
 }
 
+static void
+SHA256_Transform_blocks(uint32_t *state, const unsigned char *data, size_t n)
+{
+	while (n--) {
+		SHA256_Transform(state, data);
+		data += 64;
+	}
+}
+
+#ifdef HAVE_SHA_NI
+/*
+ * SHA256 block compression using the x86 SHA extensions.  The state is kept
+ * in the ABEF/CDGH register layout expected by sha256rnds2 while processing
+ * all blocks, the message schedule for 4 rounds at a time in M[].
+ */
+__attribute__((target("sha,sse4.1")))
+static void
+SHA256_Transform_shani(uint32_t *state, const unsigned char *data, size_t n)
+{
+	const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+					    0x0405060700010203ULL);
+	__m128i STATE0, STATE1, ABEF, CDGH, MSG, TMP;
+	__m128i M[4];
+	int i;
+
+	TMP = _mm_loadu_si128((const __m128i *)&state[0]);
+	STATE1 = _mm_loadu_si128((const __m128i *)&state[4]);
+	TMP = _mm_shuffle_epi32(TMP, 0xb1);
+	STATE1 = _mm_shuffle_epi32(STATE1, 0x1b);
+	STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);
+	STATE1 = _mm_blend_epi16(STATE1, TMP, 0xf0);
+
+	while (n--) {
+		ABEF = STATE0;
+		CDGH = STATE1;
+
+		for (i = 0; i < 16; i++) {
+			if (i < 4) {
+				MSG = _mm_loadu_si128((const __m128i *)(data + i * 16));
+				M[i] = _mm_shuffle_epi8(MSG, MASK);
+			} else {
+				TMP = _mm_sha256msg1_epu32(M[i & 3], M[(i + 1) & 3]);
+				TMP = _mm_add_epi32(TMP, _mm_alignr_epi8(M[(i + 3) & 3],
+									 M[(i + 2) & 3], 4));
+				M[i & 3] = _mm_sha256msg2_epu32(TMP, M[(i + 3) & 3]);
+			}
+
+			MSG = _mm_add_epi32(M[i & 3],
+					    _mm_loadu_si128((const __m128i *)&K[i * 4]));
+			STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+			MSG = _mm_shuffle_epi32(MSG, 0x0e);
+			STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+		}
+
+		STATE0 = _mm_add_epi32(STATE0, ABEF);
+		STATE1 = _mm_add_epi32(STATE1, CDGH);
+		data += 64;
+	}
+
+	TMP = _mm_shuffle_epi32(STATE0, 0x1b);
+	STATE1 = _mm_shuffle_epi32(STATE1, 0xb1);
+	STATE0 = _mm_blend_epi16(TMP, STATE1, 0xf0);
+	STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);
+
+	_mm_storeu_si128((__m128i *)&state[0], STATE0);
+	_mm_storeu_si128((__m128i *)&state[4], STATE1);
+}
+
+static bool
+SHA256_have_shani(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+	    !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+		return false;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return false;
+
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+	return ebx & (1 << 29);
+}
+#endif
+
+/* Compress n consecutive blocks, using the CPU's SHA instructions if present */
+static void (*SHA256_Blocks)(uint32_t *state, const unsigned char *data, size_t n);
+
+static void
+SHA256_Select(void)
+{
+	SHA256_Blocks = SHA256_Transform_blocks;
+#ifdef HAVE_SHA_NI
+	if (SHA256_have_shani())
+		SHA256_Blocks = SHA256_Transform_shani;
+#endif
+}
+
 static unsigned char PAD[64] = {
 	0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -585,7 +695,7 @@ SHA256_Pad(SHA256_CTX * ctx)
 	} else {
 		/* Finish the current block and mix. */
 		memcpy(&ctx->buf[r], PAD, 64 - r);
-		SHA256_Transform(ctx->state, ctx->buf);
+		SHA256_Blocks(ctx->state, ctx->buf, 1);
 
 		/* The start of the final block is all zeroes. */
 		memset(&ctx->buf[0], 0, 56);
@@ -595,7 +705,7 @@ SHA256_Pad(SHA256_CTX * ctx)
 	be64enc(&ctx->buf[56], ctx->count);
 
 	/* Mix in the final block. */
-	SHA256_Transform(ctx->state, ctx->buf);
+	SHA256_Blocks(ctx->state, ctx->buf, 1);
 }
 
 /* SHA-256 initialization.  Begins a SHA-256 operation. */
@@ -603,6 +713,9 @@ static void
 SHA256_Init(SHA256_CTX * ctx)
 {
 
+	if (!SHA256_Blocks)
+		SHA256_Select();
+
 	/* Zero bits processed so far */
 	ctx->count = 0;
 
@@ -641,16 +754,18 @@ SHA256_Update(SHA256_CTX * ctx, const void *in, size_t len)
 	}
 
 	/* Finish the current block */
-	memcpy(&ctx->buf[r], src, 64 - r);
-	SHA256_Transform(ctx->state, ctx->buf);
-	src += 64 - r;
-	len -= 64 - r;
+	if (r) {
+		memcpy(&ctx->buf[r], src, 64 - r);
+		SHA256_Blocks(ctx->state, ctx->buf, 1);
+		src += 64 - r;
+		len -= 64 - r;
+	}
 
 	/* Perform complete blocks */
-	while (len >= 64) {
-		SHA256_Transform(ctx->state, src);
-		src += 64;
-		len -= 64;
+	if (len >= 64) {
+		SHA256_Blocks(ctx->state, src, len / 64);
+		src += len & ~(size_t)63;
+		len &= 63;
 	}
 
 	/* Copy left over data into buffer */
@@ -676,7 +791,8 @@ SHA256_Final(unsigned char digest[static SHA256_DIGEST_LENGTH], SHA256_CTX *ctx)
 
 static void *hash_buf(FILE *f, int *len)
 {
-	static char buf[1024];
+	/* large enough for fread to bypass stdio buffering */
+	static char buf[256 * 1024] __attribute__((aligned(64)));
 
 	*len = fread(buf, 1, sizeof(buf), f);
 
@@ -748,6 +864,7 @@ static int usage(const char *progname)
 		"Options:\n"
 		"	-n		Print filename(s)\n"
 		"	-N		Suppress trailing newline\n"
+		"	-j <jobs>	Hash multiple files in parallel (0: one job per CPU)\n"
 		"\n"
 		"Supported hash types:", progname);
 
@@ -772,8 +889,20 @@ static struct hash_type *get_hash_type(const char *name)
 }
 
 
-static int hash_file(struct hash_type *t, const char *filename, bool add_filename,
-	bool no_newline)
+enum hash_status {
+	HASH_OK,
+	HASH_ERR_ISDIR,
+	HASH_ERR_OPEN,
+	HASH_ERR_HASH,
+};
+
+struct hash_result {
+	enum hash_status status;
+	char str[SHA256_DIGEST_STRING_LENGTH];
+};
+
+static void hash_file_result(struct hash_type *t, const char *filename,
+	struct hash_result *res)
 {
 	const char *str;
 
@@ -783,42 +912,131 @@ static int hash_file(struct hash_type *t, const char *filename, bool add_filenam
 		struct stat path_stat;
 		stat(filename, &path_stat);
 		if (S_ISDIR(path_stat.st_mode)) {
-			fprintf(stderr, "Failed to open '%s': Is a directory\n", filename);
-			return 1;
+			res->status = HASH_ERR_ISDIR;
+			return;
 		}
 
 		FILE *f = fopen(filename, "r");
 
 		if (!f) {
-			fprintf(stderr, "Failed to open '%s'\n", filename);
-			return 1;
+			res->status = HASH_ERR_OPEN;
+			return;
 		}
 		str = t->func(f);
 		fclose(f);
 	}
 
 	if (!str) {
+		res->status = HASH_ERR_HASH;
+		return;
+	}
+
+	res->status = HASH_OK;
+	strcpy(res->str, str);
+}
+
+static int hash_print(const char *filename, struct hash_result *res,
+	bool add_filename, bool no_newline)
+{
+	switch (res->status) {
+	case HASH_OK:
+		break;
+	case HASH_ERR_ISDIR:
+		fprintf(stderr, "Failed to open '%s': Is a directory\n", filename);
+		return 1;
+	case HASH_ERR_OPEN:
+		fprintf(stderr, "Failed to open '%s'\n", filename);
+		return 1;
+	default:
 		fprintf(stderr, "Failed to generate hash\n");
 		return 1;
 	}
 
 	if (add_filename)
-		printf("%s %s%s", str, filename ? filename : "-",
+		printf("%s %s%s", res->str, filename ? filename : "-",
 			no_newline ? "" : "\n");
 	else
-		printf("%s%s", str, no_newline ? "" : "\n");
+		printf("%s%s", res->str, no_newline ? "" : "\n");
 	return 0;
 }
 
+static int hash_file(struct hash_type *t, const char *filename, bool add_filename,
+	bool no_newline)
+{
+	struct hash_result res;
+
+	hash_file_result(t, filename, &res);
+
+	return hash_print(filename, &res, add_filename, no_newline);
+}
+
+/*
+ * Hash the files in up to 'jobs' processes, which pick the next unhashed file
+ * from a shared counter and store the result in shared memory. The output is
+ * printed in command line order once all files are done, stopping at the first
+ * error like the sequential version.
+ */
+static int hash_files_parallel(struct hash_type *t, char **files, int n_files,
+	int jobs, bool add_filename, bool no_newline)
+{
+	struct hash_shared {
+		int next;
+		struct hash_result res[];
+	} *sh;
+	size_t size = sizeof(*sh) + n_files * sizeof(sh->res[0]);
+	pid_t pid;
+	int i, n_workers = 0;
+
+	sh = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+		  -1, 0);
+	if (sh == MAP_FAILED) {
+		for (i = 0; i < n_files; i++)
+			if (hash_file(t, files[i], add_filename, no_newline))
+				return 1;
+		return 0;
+	}
+
+	/* results of workers that died stay at HASH_ERR_HASH */
+	for (i = 0; i < n_files; i++)
+		sh->res[i].status = HASH_ERR_HASH;
+
+	fflush(NULL);
+	while (n_workers < jobs - 1 && n_workers < n_files - 1) {
+		pid = fork();
+		if (pid < 0)
+			break;
+		if (!pid) {
+			while ((i = __sync_fetch_and_add(&sh->next, 1)) < n_files)
+				hash_file_result(t, files[i], &sh->res[i]);
+			_exit(0);
+		}
+		n_workers++;
+	}
+
+	while ((i = __sync_fetch_and_add(&sh->next, 1)) < n_files)
+		hash_file_result(t, files[i], &sh->res[i]);
+
+	while (n_workers > 0 && wait(NULL) > 0)
+		n_workers--;
+
+	for (i = 0; i < n_files; i++)
+		if (hash_print(files[i], &sh->res[i], add_filename, no_newline))
+			break;
+
+	munmap(sh, size);
+
+	return i < n_files;
+}
+
 
 int main(int argc, char **argv)
 {
 	struct hash_type *t;
 	const char *progname = argv[0];
-	int i, ch;
+	int i, ch, jobs = 1;
 	bool add_filename = false, no_newline = false;
 
-	while ((ch = getopt(argc, argv, "nN")) != -1) {
+	while ((ch = getopt(argc, argv, "nNj:")) != -1) {
 		switch (ch) {
 		case 'n':
 			add_filename = true;
@@ -826,6 +1044,11 @@ int main(int argc, char **argv)
 		case 'N':
 			no_newline = true;
 			break;
+		case 'j':
+			jobs = atoi(optarg);
+			if (jobs <= 0)
+				jobs = sysconf(_SC_NPROCESSORS_ONLN);
+			break;
 		default:
 			return usage(progname);
 		}
@@ -844,6 +1067,10 @@ int main(int argc, char **argv)
 	if (argc < 2)
 		return hash_file(t, NULL, add_filename, no_newline);
 
+	if (jobs > 1 && argc > 2)
+		return hash_files_parallel(t, argv + 1, argc - 1, jobs,
+					   add_filename, no_newline);
+
 	for (i = 0; i < argc - 1; i++) {
 		int ret = hash_file(t, argv[1 + i], add_filename, no_newline);
 		if (ret)
@@ -34,6 +34,7 @@
 #include <linux/of.h>
 #include <linux/mfd/syscon.h>
 #include <linux/regmap.h>
+#include <net/page_pool/helpers.h>
 
 #include <linux/bitops.h>
 
@@ -66,6 +67,7 @@
 #define AG71XX_RX_RING_SIZE_DEFAULT	256
 
 #define AG71XX_TX_RING_SIZE_MAX		256
+#define AG71XX_TX_RING_SIZE_MIN		roundup_pow_of_two(2 * (MAX_SKB_FRAGS + 1))
 #define AG71XX_RX_RING_SIZE_MAX		256
 
 #ifdef CONFIG_AG71XX_DEBUG
@@ -156,6 +158,8 @@ struct ag71xx {
 
 	int			mac_idx;
 
+	struct page_pool	*page_pool;
+
 	u16			desc_pktlen_mask;
 	u16			rx_buf_size;
 	u8			rx_buf_offset;
@@ -116,7 +116,7 @@ ag71xx_ethtool_set_ringparam(struct net_device *dev,
 	if (er->rx_mini_pending != 0||
 	    er->rx_jumbo_pending != 0 ||
 	    er->rx_pending == 0 ||
-	    er->tx_pending == 0)
+	    er->tx_pending < AG71XX_TX_RING_SIZE_MIN)
 		return -EINVAL;
 
 	tx_size = er->tx_pending < AG71XX_TX_RING_SIZE_MAX ?
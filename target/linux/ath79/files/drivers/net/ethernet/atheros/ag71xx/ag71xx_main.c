@@ -162,9 +162,9 @@ static void ag71xx_ring_rx_clean(struct ag71xx *ag)
 
 	for (i = 0; i < ring_size; i++)
 		if (ring->buf[i].rx_buf) {
-			dma_unmap_single(&ag->pdev->dev, ring->buf[i].dma_addr,
-					 ag->rx_buf_size, DMA_FROM_DEVICE);
-			skb_free_frag(ring->buf[i].rx_buf);
+			page_pool_put_full_page(ag->page_pool,
+				virt_to_head_page(ring->buf[i].rx_buf), false);
+			ring->buf[i].rx_buf = NULL;
 		}
 }
 
@@ -174,21 +174,48 @@ static int ag71xx_buffer_size(struct ag71xx *ag)
 	       SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
 }
 
+static int ag71xx_page_pool_create(struct ag71xx *ag)
+{
+	struct page_pool_params pp_params = {
+		.flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV |
+			 PP_FLAG_PAGE_FRAG,
+		.order = get_order(ag71xx_buffer_size(ag)),
+		.pool_size = BIT(ag->rx_ring.order),
+		.nid = NUMA_NO_NODE,
+		.dev = &ag->pdev->dev,
+		.napi = &ag->napi,
+		.dma_dir = DMA_FROM_DEVICE,
+	};
+
+	/* a page may hold more than one buffer, sync all of it on recycle */
+	pp_params.max_len = PAGE_SIZE << pp_params.order;
+
+	ag->page_pool = page_pool_create(&pp_params);
+	if (IS_ERR(ag->page_pool)) {
+		int err = PTR_ERR(ag->page_pool);
+
+		ag->page_pool = NULL;
+		return err;
+	}
+
+	return 0;
+}
+
 static bool ag71xx_fill_rx_buf(struct ag71xx *ag, struct ag71xx_buf *buf,
-			       int offset,
-			       void *(*alloc)(unsigned int size))
+			       int offset, gfp_t gfp)
 {
 	struct ag71xx_ring *ring = &ag->rx_ring;
 	struct ag71xx_desc *desc = ag71xx_ring_desc(ring, buf - &ring->buf[0]);
-	void *data;
+	unsigned int page_offset;
+	struct page *page;
 
-	data = alloc(ag71xx_buffer_size(ag));
-	if (!data)
+	page = page_pool_alloc_frag(ag->page_pool, &page_offset,
+				    ag71xx_buffer_size(ag), gfp);
+	if (!page)
 		return false;
 
-	buf->rx_buf = data;
-	buf->dma_addr = dma_map_single(&ag->pdev->dev, data, ag->rx_buf_size,
-				       DMA_FROM_DEVICE);
+	buf->rx_buf = page_address(page) + page_offset;
+	buf->dma_addr = page_pool_get_dma_addr(page) + page_offset;
 	desc->data = (u32) buf->dma_addr + offset;
 	return true;
 }
@@ -216,7 +243,7 @@ static int ag71xx_ring_rx_init(struct ag71xx *ag)
 		struct ag71xx_desc *desc = ag71xx_ring_desc(ring, i);
 
 		if (!ag71xx_fill_rx_buf(ag, &ring->buf[i], ag->rx_buf_offset,
-					netdev_alloc_frag)) {
+					GFP_KERNEL)) {
 			ret = -ENOMEM;
 			break;
 		}
@@ -250,7 +277,7 @@ static int ag71xx_ring_rx_refill(struct ag71xx *ag)
 
 		if (!ring->buf[i].rx_buf &&
 		    !ag71xx_fill_rx_buf(ag, &ring->buf[i], offset,
-					napi_alloc_frag))
+					GFP_ATOMIC | __GFP_NOWARN))
 			break;
 
 		desc->ctrl = DESC_EMPTY;
@@ -271,17 +298,23 @@ static int ag71xx_rings_init(struct ag71xx *ag)
 	struct ag71xx_ring *rx = &ag->rx_ring;
 	int ring_size = BIT(tx->order) + BIT(rx->order);
 	int tx_size = BIT(tx->order);
+	int ret;
+
+	ret = ag71xx_page_pool_create(ag);
+	if (ret)
+		return ret;
 
 	tx->buf = kzalloc(ring_size * sizeof(*tx->buf), GFP_KERNEL);
-	if (!tx->buf)
-		return -ENOMEM;
+	if (!tx->buf) {
+		ret = -ENOMEM;
+		goto err_pool;
+	}
 
 	tx->descs_cpu = dma_alloc_coherent(&ag->pdev->dev, ring_size * AG71XX_DESC_SIZE,
 					   &tx->descs_dma, GFP_KERNEL);
 	if (!tx->descs_cpu) {
-		kfree(tx->buf);
-		tx->buf = NULL;
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto err_buf;
 	}
 
 	rx->buf = &tx->buf[tx_size];
@@ -290,6 +323,14 @@ static int ag71xx_rings_init(struct ag71xx *ag)
 
 	ag71xx_ring_tx_init(ag);
 	return ag71xx_ring_rx_init(ag);
+
+err_buf:
+	kfree(tx->buf);
+	tx->buf = NULL;
+err_pool:
+	page_pool_destroy(ag->page_pool);
+	ag->page_pool = NULL;
+	return ret;
 }
 
 static void ag71xx_rings_free(struct ag71xx *ag)
@@ -308,6 +349,9 @@ static void ag71xx_rings_free(struct ag71xx *ag)
 	rx->descs_cpu = NULL;
 	tx->buf = NULL;
 	rx->buf = NULL;
+
+	page_pool_destroy(ag->page_pool);
+	ag->page_pool = NULL;
 }
 
 static void ag71xx_rings_cleanup(struct ag71xx *ag)
@@ -1042,7 +1086,8 @@ static int ag71xx_stop(struct net_device *dev)
 	return 0;
 }
 
-static int ag71xx_fill_dma_desc(struct ag71xx_ring *ring, u32 addr, int len)
+static int ag71xx_fill_dma_desc(struct ag71xx_ring *ring, int start,
+				u32 addr, int len, bool more)
 {
 	int i;
 	struct ag71xx_desc *desc;
@@ -1056,11 +1101,11 @@ static int ag71xx_fill_dma_desc(struct ag71xx_ring *ring, u32 addr, int len)
 	while (len > 0) {
 		unsigned int cur_len = len;
 
-		i = (ring->curr + ndesc) & ring_mask;
+		i = (ring->curr + start + ndesc) & ring_mask;
 		desc = ag71xx_ring_desc(ring, i);
 
 		if (!ag71xx_desc_empty(desc))
-			return -1;
+			goto err;
 
 		if (cur_len > split) {
 			cur_len = split;
@@ -1077,11 +1122,11 @@ static int ag71xx_fill_dma_desc(struct ag71xx_ring *ring, u32 addr, int len)
 		addr += cur_len;
 		len -= cur_len;
 
-		if (len > 0)
+		if (len > 0 || more)
 			cur_len |= DESC_MORE;
 
 		/* prevent early tx attempt of this descriptor */
-		if (!ndesc)
+		if (!start && !ndesc)
 			cur_len |= DESC_EMPTY;
 
 		desc->ctrl = cur_len;
@@ -1089,6 +1134,48 @@ static int ag71xx_fill_dma_desc(struct ag71xx_ring *ring, u32 addr, int len)
 	}
 
 	return ndesc;
+
+err:
+	while (ndesc-- > 0) {
+		i = (ring->curr + start + ndesc) & ring_mask;
+		ag71xx_ring_desc(ring, i)->ctrl = DESC_EMPTY;
+	}
+
+	return -1;
+}
+
+/* TX will hang if DMA transfers <= 4 bytes, fragments that small are copied */
+static bool ag71xx_tx_frags_ok(struct sk_buff *skb)
+{
+	int i;
+
+	if (skb_headlen(skb) <= 4)
+		return false;
+
+	for (i = 0; i < skb_shinfo(skb)->nr_frags; i++)
+		if (skb_frag_size(&skb_shinfo(skb)->frags[i]) <= 4)
+			return false;
+
+	return true;
+}
+
+static void ag71xx_tx_unwind(struct ag71xx *ag, int ndesc, dma_addr_t *addrs,
+			     unsigned int *lens, int nmap)
+{
+	struct ag71xx_ring *ring = &ag->tx_ring;
+	int ring_mask = BIT(ring->order) - 1;
+	int i;
+
+	for (i = 0; i < ndesc; i++)
+		ag71xx_ring_desc(ring, (ring->curr + i) & ring_mask)->ctrl =
+			DESC_EMPTY;
+
+	if (nmap)
+		dma_unmap_single(&ag->pdev->dev, addrs[0], lens[0],
+				 DMA_TO_DEVICE);
+	for (i = 1; i < nmap; i++)
+		dma_unmap_page(&ag->pdev->dev, addrs[i], lens[i],
+			       DMA_TO_DEVICE);
 }
 
 static netdev_tx_t ag71xx_hard_start_xmit(struct sk_buff *skb,
@@ -1098,36 +1185,61 @@ static netdev_tx_t ag71xx_hard_start_xmit(struct sk_buff *skb,
 	struct ag71xx_ring *ring = &ag->tx_ring;
 	int ring_mask = BIT(ring->order) - 1;
 	int ring_size = BIT(ring->order);
+	dma_addr_t addrs[MAX_SKB_FRAGS + 1];
+	unsigned int lens[MAX_SKB_FRAGS + 1];
 	struct ag71xx_desc *desc;
-	dma_addr_t dma_addr;
-	int i, n, ring_min;
+	int i, n, nfrags, ndesc, ring_min;
 
 	if (skb->len <= 4) {
 		DBG("%s: packet len is too small\n", ag->dev->name);
 		goto err_drop;
 	}
 
-	dma_addr = dma_map_single(&ag->pdev->dev, skb->data, skb->len,
-				  DMA_TO_DEVICE);
+	if (skb_shinfo(skb)->nr_frags && !ag71xx_tx_frags_ok(skb) &&
+	    skb_linearize(skb))
+		goto err_drop;
+
+	nfrags = skb_shinfo(skb)->nr_frags;
 
-	i = ring->curr & ring_mask;
-	desc = ag71xx_ring_desc(ring, i);
+	lens[0] = skb_headlen(skb);
+	addrs[0] = dma_map_single(&ag->pdev->dev, skb->data, lens[0],
+				  DMA_TO_DEVICE);
 
 	/* setup descriptor fields */
-	n = ag71xx_fill_dma_desc(ring, (u32) dma_addr, skb->len & ag->desc_pktlen_mask);
-	if (n < 0)
-		goto err_drop_unmap;
+	ndesc = ag71xx_fill_dma_desc(ring, 0, (u32) addrs[0],
+				     lens[0] & ag->desc_pktlen_mask, nfrags);
+	if (ndesc < 0) {
+		ag71xx_tx_unwind(ag, 0, addrs, lens, 1);
+		goto err_drop;
+	}
+
+	for (i = 0; i < nfrags; i++) {
+		skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
 
-	i = (ring->curr + n - 1) & ring_mask;
+		lens[i + 1] = skb_frag_size(frag);
+		addrs[i + 1] = skb_frag_dma_map(&ag->pdev->dev, frag, 0,
+						lens[i + 1], DMA_TO_DEVICE);
+
+		n = ag71xx_fill_dma_desc(ring, ndesc, (u32) addrs[i + 1],
+					 lens[i + 1] & ag->desc_pktlen_mask,
+					 i < nfrags - 1);
+		if (n < 0) {
+			ag71xx_tx_unwind(ag, ndesc, addrs, lens, i + 2);
+			goto err_drop;
+		}
+
+		ndesc += n;
+	}
+
+	i = (ring->curr + ndesc - 1) & ring_mask;
 	ring->buf[i].len = skb->len;
 	ring->buf[i].skb = skb;
 
-	netdev_sent_queue(dev, skb->len);
-
 	skb_tx_timestamp(skb);
 
+	desc = ag71xx_ring_desc(ring, ring->curr & ring_mask);
 	desc->ctrl &= ~DESC_EMPTY;
-	ring->curr += n;
+	ring->curr += ndesc;
 
 	/* flush descriptor */
 	wmb();
@@ -1135,6 +1247,7 @@ static netdev_tx_t ag71xx_hard_start_xmit(struct sk_buff *skb,
 	ring_min = 2;
 	if (ring->desc_split)
 	    ring_min *= AG71XX_TX_RING_DS_PER_PKT;
+	ring_min += MAX_SKB_FRAGS;
 
 	if (ring->curr - ring->dirty >= ring_size - ring_min) {
 		DBG("%s: tx queue full\n", dev->name);
@@ -1143,17 +1256,22 @@ static netdev_tx_t ag71xx_hard_start_xmit(struct sk_buff *skb,
 
 	DBG("%s: packet injected into TX queue\n", ag->dev->name);
 
-	/* enable TX engine */
-	ag71xx_wr(ag, AG71XX_REG_TX_CTRL, TX_CTRL_TXE);
+	/*
+	 * Enabling the TX engine is an uncached write plus read back, only
+	 * do it for the last packet of a batch or when the queue stopped.
+	 */
+	if (__netdev_sent_queue(dev, skb->len, netdev_xmit_more()))
+		ag71xx_wr(ag, AG71XX_REG_TX_CTRL, TX_CTRL_TXE);
 
 	return NETDEV_TX_OK;
 
-err_drop_unmap:
-	dma_unmap_single(&ag->pdev->dev, dma_addr, skb->len, DMA_TO_DEVICE);
-
 err_drop:
 	dev->stats.tx_dropped++;
 
+	/* packets queued earlier in this batch still need a kick */
+	if (!netdev_xmit_more())
+		ag71xx_wr(ag, AG71XX_REG_TX_CTRL, TX_CTRL_TXE);
+
 	dev_kfree_skb(skb);
 	return NETDEV_TX_OK;
 }
@@ -1295,13 +1413,11 @@ static int ag71xx_rx_packets(struct ag71xx *ag, int limit)
 	unsigned int offset = ag->rx_buf_offset;
 	int ring_mask = BIT(ring->order) - 1;
 	int ring_size = BIT(ring->order);
-	struct list_head rx_list;
 	struct sk_buff *skb;
 	int done = 0;
 
 	DBG("%s: rx packets, limit=%d, curr=%u, dirty=%u\n",
 			dev->name, limit, ring->curr, ring->dirty);
-	INIT_LIST_HEAD(&rx_list);
 
 	while (done < limit) {
 		unsigned int i = ring->curr & ring_mask;
@@ -1320,20 +1436,27 @@ static int ag71xx_rx_packets(struct ag71xx *ag, int limit)
 		ag71xx_wr(ag, AG71XX_REG_RX_STATUS, RX_STATUS_PR);
 
 		pktlen = desc->ctrl & pktlen_mask;
-		pktlen -= ETH_FCS_LEN;
 
-		dma_unmap_single(&ag->pdev->dev, ring->buf[i].dma_addr,
-				 ag->rx_buf_size, DMA_FROM_DEVICE);
+		/*
+		 * Only the received part of the buffer needs to be synced,
+		 * the page pool keeps the buffers mapped while recycling.
+		 */
+		dma_sync_single_for_cpu(&ag->pdev->dev,
+					ring->buf[i].dma_addr + offset,
+					pktlen, DMA_FROM_DEVICE);
+		pktlen -= ETH_FCS_LEN;
 
 		dev->stats.rx_packets++;
 		dev->stats.rx_bytes += pktlen;
 
 		skb = napi_build_skb(ring->buf[i].rx_buf, ag71xx_buffer_size(ag));
 		if (!skb) {
-			skb_free_frag(ring->buf[i].rx_buf);
+			page_pool_put_full_page(ag->page_pool,
+				virt_to_head_page(ring->buf[i].rx_buf), true);
 			goto next;
 		}
 
+		skb_mark_for_recycle(skb);
 		skb_reserve(skb, offset);
 		skb_put(skb, pktlen);
 
@@ -1343,7 +1466,8 @@ static int ag71xx_rx_packets(struct ag71xx *ag, int limit)
 		} else {
 			skb->dev = dev;
 			skb->ip_summed = CHECKSUM_NONE;
-			list_add_tail(&skb->list, &rx_list);
+			skb->protocol = eth_type_trans(skb, dev);
+			napi_gro_receive(&ag->napi, skb);
 		}
 
 next:
@@ -1355,10 +1479,6 @@ next:
 
 	ag71xx_ring_rx_refill(ag);
 
-	list_for_each_entry(skb, &rx_list, list)
-		skb->protocol = eth_type_trans(skb, dev);
-	netif_receive_skb_list(&rx_list);
-
 	DBG("%s: rx finish, curr=%u, dirty=%u, done=%d\n",
 		dev->name, ring->curr, ring->dirty, done);
 
@@ -1406,7 +1526,7 @@ static int ag71xx_poll(struct napi_struct *napi, int limit)
 		DBG("%s: disable polling mode, rx=%d, tx=%d,limit=%d\n",
 			dev->name, rx_done, tx_done, limit);
 
-		napi_complete(napi);
+		napi_complete_done(napi, rx_done);
 
 		/* enable interrupts */
 		spin_lock_irqsave(&ag->lock, flags);
@@ -1588,6 +1708,8 @@ static int ag71xx_probe(struct platform_device *pdev)
 
 	dev->netdev_ops = &ag71xx_netdev_ops;
 	dev->ethtool_ops = &ag71xx_ethtool_ops;
+	dev->features |= NETIF_F_SG;
+	dev->hw_features |= NETIF_F_SG;
 
 	INIT_DELAYED_WORK(&ag->restart_work, ag71xx_restart_work_func);
 
@@ -19,11 +19,112 @@
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/partitions.h>
 #include <linux/byteorder/generic.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
 
 #include "mtdsplit.h"
 
 #define UBI_EC_MAGIC			0x55424923	/* UBI# */
 
+#define MTDSPLIT_SCAN_CACHE_SLOTS	4
+
+/* per eraseblock scan state, a type is stored as SCAN_TYPE + type */
+enum {
+	SCAN_UNKNOWN,
+	SCAN_NO_MAGIC,
+	SCAN_TYPE,
+};
+
+/*
+ * Several parsers may probe the same eraseblocks for a rootfs magic while
+ * a firmware partition is being split, e.g. when one parser after the other
+ * fails on it. Remember the result of each probe per master device and
+ * eraseblock, so the flash is only read once. This is only done while
+ * booting, later partition refreshes (e.g. after a sysupgrade) always read
+ * the flash again.
+ */
+struct mtdsplit_scan_cache {
+	struct mtd_info *master;
+	u32 erasesize;
+	u32 n_blocks;
+	u8 *state;
+};
+
+static struct mtdsplit_scan_cache scan_cache[MTDSPLIT_SCAN_CACHE_SLOTS];
+static DEFINE_MUTEX(scan_cache_lock);
+
+static void mtdsplit_scan_cache_drop(struct mtdsplit_scan_cache *c)
+{
+	kfree(c->state);
+	memset(c, 0, sizeof(*c));
+}
+
+/* returns the state slot for the eraseblock at offset, or NULL */
+static u8 *mtdsplit_scan_cache_slot(struct mtd_info *mtd, size_t offset)
+{
+	struct mtd_info *master = mtd_get_master(mtd);
+	struct mtdsplit_scan_cache *c, *free = NULL;
+	u64 ofs = mtd_get_master_ofs(mtd, offset);
+	int i;
+
+	lockdep_assert_held(&scan_cache_lock);
+
+	if (system_state >= SYSTEM_RUNNING) {
+		for (i = 0; i < ARRAY_SIZE(scan_cache); i++)
+			mtdsplit_scan_cache_drop(&scan_cache[i]);
+		return NULL;
+	}
+
+	if (master->numeraseregions || !master->erasesize ||
+	    mtd_mod_by_eb(ofs, master) || ofs >= master->size)
+		return NULL;
+
+	for (i = 0; i < ARRAY_SIZE(scan_cache); i++) {
+		c = &scan_cache[i];
+		if (c->master == master && c->erasesize == master->erasesize)
+			goto found;
+		if (!c->master && !free)
+			free = c;
+	}
+
+	if (!free)
+		return NULL;
+
+	c = free;
+	c->n_blocks = mtd_div_by_eb(master->size, master);
+	c->state = kcalloc(c->n_blocks, sizeof(*c->state), GFP_KERNEL);
+	if (!c->state)
+		return NULL;
+
+	c->master = master;
+	c->erasesize = master->erasesize;
+
+found:
+	return &c->state[mtd_div_by_eb(ofs, master)];
+}
+
+static void mtdsplit_notify_add(struct mtd_info *mtd)
+{
+}
+
+/* the cache is keyed by pointer, forget about devices going away */
+static void mtdsplit_notify_remove(struct mtd_info *mtd)
+{
+	struct mtd_info *master = mtd_get_master(mtd);
+	int i;
+
+	mutex_lock(&scan_cache_lock);
+	for (i = 0; i < ARRAY_SIZE(scan_cache); i++)
+		if (scan_cache[i].master == master)
+			mtdsplit_scan_cache_drop(&scan_cache[i]);
+	mutex_unlock(&scan_cache_lock);
+}
+
+static struct mtd_notifier mtdsplit_notifier = {
+	.add	= mtdsplit_notify_add,
+	.remove	= mtdsplit_notify_remove,
+};
+
 struct squashfs_super_block {
 	__le32 s_magic;
 	__le32 pad0[9];
@@ -72,8 +173,8 @@ static ssize_t mtd_next_eb(struct mtd_info *mtd, size_t offset)
 	return mtd_rounddown_to_eb(offset, mtd) + mtd->erasesize;
 }
 
-int mtd_check_rootfs_magic(struct mtd_info *mtd, size_t offset,
-			   enum mtdsplit_part_type *type)
+static int __mtd_check_rootfs_magic(struct mtd_info *mtd, size_t offset,
+				    enum mtdsplit_part_type *type)
 {
 	u32 magic;
 	size_t retlen;
@@ -88,21 +189,60 @@ int mtd_check_rootfs_magic(struct mtd_info *mtd, size_t offset,
 		return -EIO;
 
 	if (le32_to_cpu(magic) == SQUASHFS_MAGIC) {
-		if (type)
-			*type = MTDSPLIT_PART_TYPE_SQUASHFS;
+		*type = MTDSPLIT_PART_TYPE_SQUASHFS;
 		return 0;
 	} else if (magic == 0x19852003) {
-		if (type)
-			*type = MTDSPLIT_PART_TYPE_JFFS2;
+		*type = MTDSPLIT_PART_TYPE_JFFS2;
 		return 0;
 	} else if (be32_to_cpu(magic) == UBI_EC_MAGIC) {
-		if (type)
-			*type = MTDSPLIT_PART_TYPE_UBI;
+		*type = MTDSPLIT_PART_TYPE_UBI;
 		return 0;
 	}
 
 	return -EINVAL;
 }
+
+static int mtdsplit_check_magic(struct mtd_info *mtd, size_t offset,
+				enum mtdsplit_part_type *type, bool *cached)
+{
+	enum mtdsplit_part_type t = MTDSPLIT_PART_TYPE_UNK;
+	u8 *state;
+	int ret;
+
+	mutex_lock(&scan_cache_lock);
+
+	state = mtdsplit_scan_cache_slot(mtd, offset);
+	*cached = state && *state != SCAN_UNKNOWN;
+	if (*cached) {
+		t = *state - SCAN_TYPE;
+		ret = *state == SCAN_NO_MAGIC ? -EINVAL : 0;
+		goto out;
+	}
+
+	ret = __mtd_check_rootfs_magic(mtd, offset, &t);
+
+	/* read errors may be transient, only remember definite answers */
+	if (state && !ret)
+		*state = SCAN_TYPE + t;
+	else if (state && ret == -EINVAL)
+		*state = SCAN_NO_MAGIC;
+
+out:
+	mutex_unlock(&scan_cache_lock);
+
+	if (!ret && type)
+		*type = t;
+
+	return ret;
+}
+
+int mtd_check_rootfs_magic(struct mtd_info *mtd, size_t offset,
+			   enum mtdsplit_part_type *type)
+{
+	bool cached;
+
+	return mtdsplit_check_magic(mtd, offset, type, &cached);
+}
 EXPORT_SYMBOL_GPL(mtd_check_rootfs_magic);
 
 int mtd_find_rootfs_from(struct mtd_info *mtd,
@@ -111,20 +251,40 @@ int mtd_find_rootfs_from(struct mtd_info *mtd,
 			 size_t *ret_offset,
 			 enum mtdsplit_part_type *type)
 {
+	unsigned int n_read = 0, n_cached = 0;
 	size_t offset;
+	bool cached;
 	int err;
 
 	for (offset = from; offset < limit;
 	     offset = mtd_next_eb(mtd, offset)) {
-		err = mtd_check_rootfs_magic(mtd, offset, type);
+		err = mtdsplit_check_magic(mtd, offset, type, &cached);
+		if (cached)
+			n_cached++;
+		else
+			n_read++;
+
 		if (err)
 			continue;
 
+		pr_debug("found rootfs in \"%s\" at 0x%zx, %u blocks read, %u cached\n",
+			 mtd->name, offset, n_read, n_cached);
+
 		*ret_offset = offset;
 		return 0;
 	}
 
+	pr_debug("no rootfs in \"%s\" 0x%zx-0x%zx, %u blocks read, %u cached\n",
+		 mtd->name, from, limit, n_read, n_cached);
+
 	return -ENODEV;
 }
 EXPORT_SYMBOL_GPL(mtd_find_rootfs_from);
 
+static int __init mtdsplit_init(void)
+{
+	register_mtd_user(&mtdsplit_notifier);
+
+	return 0;
+}
+subsys_initcall(mtdsplit_init);
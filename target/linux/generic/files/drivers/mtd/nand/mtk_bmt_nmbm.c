@@ -1,4 +1,6 @@
+#include <linux/bitops.h>
 #include <linux/crc32.h>
+#include <linux/ktime.h>
 #include <linux/slab.h>
 #include "mtk_bmt.h"
 
@@ -259,6 +261,35 @@ static int nmbm_read_phys_page(struct nmbm_instance *ni, uint64_t addr,
 	return ret;
 }
 
+/*
+ * nmbm_read_phys_pages - Read multiple pages at once
+ * @ni: NMBM instance structure
+ * @addr: linear address of the first page
+ * @data: buffer to store the main data
+ * @size: number of bytes to read, a multiple of page size
+ *
+ * Read a range of pages with a single request to the lower device, without
+ * retries.
+ *
+ * Return 0 for success, negative value for errors.
+ */
+static int nmbm_read_phys_pages(struct nmbm_instance *ni, uint64_t addr,
+				void *data, uint32_t size)
+{
+	struct mtd_oob_ops ops = {
+		.mode = MTD_OPS_PLACE_OOB,
+		.datbuf = data,
+		.len = size,
+	};
+	int ret;
+
+	ret = bmtd._read_oob(bmtd.mtd, addr, &ops);
+	if (ret == -EUCLEAN || (ret >= 0 && ops.retlen == size))
+		return 0;
+
+	return ret < 0 ? ret : -EIO;
+}
+
 /*
  * nmbm_write_phys_page - Write page with retry
  * @ni: NMBM instance structure
@@ -478,6 +509,20 @@ static bool nmbm_set_block_state(struct nmbm_instance *ni, uint32_t ba,
 	return false;
 }
 
+/*
+ * nmbm_good_blocks_in_unit - Count good blocks in one unit of block state table
+ * @ni: NMBM instance structure
+ * @ba: block address of any block within the unit
+ *
+ * A block is good if both of its state bits are set.
+ */
+static uint32_t nmbm_good_blocks_in_unit(struct nmbm_instance *ni, uint32_t ba)
+{
+	u32 uv = ni->block_state[ba / NMBM_BITMAP_BLOCKS_PER_UNIT];
+
+	return hweight32(uv & (uv >> 1) & 0x55555555);
+}
+
 /*
  * nmbm_block_walk_asc - Skip specified number of good blocks, ascending addr.
  * @ni: NMBM instance structure
@@ -504,6 +549,18 @@ static bool nmbm_block_walk_asc(struct nmbm_instance *ni, uint32_t ba,
 		limit = ni->block_count - 1;
 
 	while (ba < limit) {
+		/* Skip whole units which can not contain the result */
+		if (!(ba % NMBM_BITMAP_BLOCKS_PER_UNIT) &&
+		    ba + NMBM_BITMAP_BLOCKS_PER_UNIT <= limit) {
+			uint32_t good = nmbm_good_blocks_in_unit(ni, ba);
+
+			if ((int32_t)good <= nblock) {
+				nblock -= good;
+				ba += NMBM_BITMAP_BLOCKS_PER_UNIT;
+				continue;
+			}
+		}
+
 		if (nmbm_get_block_state(ni, ba) == BLOCK_ST_GOOD)
 			nblock--;
 
@@ -543,6 +600,19 @@ static bool nmbm_block_walk_desc(struct nmbm_instance *ni, uint32_t ba,
 		limit = ni->block_count - 1;
 
 	while (ba > limit) {
+		/* Skip whole units which can not contain the result */
+		if (ba % NMBM_BITMAP_BLOCKS_PER_UNIT ==
+		    NMBM_BITMAP_BLOCKS_PER_UNIT - 1 &&
+		    ba >= limit + NMBM_BITMAP_BLOCKS_PER_UNIT) {
+			uint32_t good = nmbm_good_blocks_in_unit(ni, ba);
+
+			if ((int32_t)good <= nblock) {
+				nblock -= good;
+				ba -= NMBM_BITMAP_BLOCKS_PER_UNIT;
+				continue;
+			}
+		}
+
 		if (nmbm_get_block_state(ni, ba) == BLOCK_ST_GOOD)
 			nblock--;
 
@@ -823,7 +893,8 @@ static bool nmbm_write_signature(struct nmbm_instance *ni, uint32_t limit,
  * @size: the size of data
  *
  * Read data range.
- * Every page will be tried for at most NMBM_TRY_COUNT times.
+ * Whole pages are read with a single request first. If that fails, every
+ * page will be tried for at most NMBM_TRY_COUNT times.
  *
  * Return 0 for success, positive value for corrected bitflip count,
  * -EBADMSG for ecc error, other negative values for other errors
@@ -836,6 +907,16 @@ static int nmbn_read_data(struct nmbm_instance *ni, uint64_t addr, void *data,
 	uint32_t sizeremain = size, chunksize, leading;
 	int ret;
 
+	if (!(addr & (bmtd.pg_size - 1)) && size >= 2 * bmtd.pg_size) {
+		chunksize = size & ~(bmtd.pg_size - 1);
+
+		if (!nmbm_read_phys_pages(ni, off, ptr, chunksize)) {
+			off += chunksize;
+			ptr += chunksize;
+			sizeremain -= chunksize;
+		}
+	}
+
 	while (sizeremain) {
 		leading = off & (bmtd.pg_size - 1);
 		chunksize = bmtd.pg_size - leading;
@@ -1753,7 +1834,7 @@ static bool nmbm_try_load_info_table(struct nmbm_instance *ni, uint32_t ba,
 	struct nmbm_info_table_header *ifthdr = (void *)ni->info_table_cache;
 	uint8_t *off = ni->info_table_cache;
 	uint32_t limit = ba + size2blk(ni, ni->info_table_size);
-	uint32_t start_ba = 0, chunksize, sizeremain = ni->info_table_size;
+	uint32_t start_ba = 0, chunksize, hdrsize, sizeremain = ni->info_table_size;
 	bool success, checkhdr = true;
 	int ret;
 
@@ -1770,18 +1851,35 @@ static bool nmbm_try_load_info_table(struct nmbm_instance *ni, uint32_t ba,
 		if (chunksize > bmtd.blk_size)
 			chunksize = bmtd.blk_size;
 
+		/*
+		 * Check the header in the first page before reading the rest
+		 * of the block, most blocks probed while searching for the
+		 * table do not contain one.
+		 */
+		hdrsize = 0;
+		if (checkhdr) {
+			hdrsize = min_t(u32, chunksize, bmtd.pg_size);
+
+			ret = nmbn_read_data(ni, ba2addr(ni, ba), off, hdrsize);
+			if (ret < 0)
+				goto skip_bad_block;
+			else if (ret > 0)
+				return false;
+
+			success = nmbm_check_info_table_header(ni, off);
+			if (!success)
+				return false;
+		}
+
 		/* Assume block with ECC error has no info table data */
-		ret = nmbn_read_data(ni, ba2addr(ni, ba), off, chunksize);
+		ret = nmbn_read_data(ni, ba2addr(ni, ba) + hdrsize,
+				     off + hdrsize, chunksize - hdrsize);
 		if (ret < 0)
 			goto skip_bad_block;
 		else if (ret > 0)
 			return false;
 
 		if (checkhdr) {
-			success = nmbm_check_info_table_header(ni, off);
-			if (!success)
-				return false;
-
 			start_ba = ba;
 			checkhdr = false;
 		}
@@ -2215,6 +2313,7 @@ static int nmbm_attach(struct nmbm_instance *ni)
 static bool remap_block_nmbm(u16 block, u16 mapped_block, int copy_len)
 {
 	struct nmbm_instance *ni = bmtd.ni;
+	ktime_t start = ktime_get();
 	int new_block;
 
 	if (block >= ni->data_block_count)
@@ -2230,6 +2329,9 @@ static bool remap_block_nmbm(u16 block, u16 mapped_block, int copy_len)
 		bbt_nand_copy(new_block, mapped_block, copy_len);
 	nmbm_update_info_table(ni);
 
+	pr_debug("nmbm: remapped block %u to %d in %lld us\n", block,
+		 new_block, ktime_us_delta(ktime_get(), start));
+
 	return true;
 }
 
@@ -2246,12 +2348,15 @@ static int get_mapping_block_index_nmbm(int block)
 static int mtk_bmt_init_nmbm(struct device_node *np)
 {
 	struct nmbm_instance *ni;
+	ktime_t start;
 	int ret;
 
 	ni = kzalloc(nmbm_calc_structure_size(), GFP_KERNEL);
 	if (!ni)
 		return -ENOMEM;
 
+	start = ktime_get();
+
 	bmtd.ni = ni;
 
 	if (of_property_read_u32(np, "mediatek,bmt-max-ratio", &ni->max_ratio))
@@ -2268,6 +2373,9 @@ static int mtk_bmt_init_nmbm(struct device_node *np)
 	if (ret)
 		goto out;
 
+	pr_debug("nmbm: attached in %lld us\n",
+		 ktime_us_delta(ktime_get(), start));
+
 	bmtd.mtd->size = ni->data_block_count << bmtd.blk_shift;
 
 	return 0;
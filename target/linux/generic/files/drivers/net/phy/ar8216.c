@@ -408,23 +408,34 @@ out:
 	return ret;
 }
 
-static int
-ar8xxx_mib_capture(struct ar8xxx_priv *priv)
+/*
+ * Like ar8xxx_read(), for a series of reads with the MDIO bus lock held.
+ * The page register is only written when the page differs from *page.
+ */
+static u32
+ar8xxx_read_paged(struct ar8xxx_priv *priv, int reg, u16 *page)
 {
-	return ar8xxx_mib_op(priv, AR8216_MIB_FUNC_CAPTURE);
-}
+	struct mii_bus *bus = priv->mii_bus;
+	u16 r1, r2, p;
 
-static int
-ar8xxx_mib_flush(struct ar8xxx_priv *priv)
-{
-	return ar8xxx_mib_op(priv, AR8216_MIB_FUNC_FLUSH);
+	split_addr((u32) reg, &r1, &r2, &p);
+
+	if (p != *page) {
+		bus->write(bus, 0x18, 0, p);
+		wait_for_page_switch();
+		*page = p;
+	}
+
+	return ar8xxx_mii_read32(priv, 0x10 | r2, r1);
 }
 
 static void
 ar8xxx_mib_fetch_port_stat(struct ar8xxx_priv *priv, int port, bool flush)
 {
+	struct mii_bus *bus = priv->mii_bus;
 	unsigned int base;
 	u64 *mib_stats;
+	u16 page = U16_MAX;
 	int i;
 
 	WARN_ON(port >= priv->dev.ports);
@@ -434,6 +445,12 @@ ar8xxx_mib_fetch_port_stat(struct ar8xxx_priv *priv, int port, bool flush)
 	base = priv->chip->reg_port_stats_start +
 	       priv->chip->reg_port_stats_length * port;
 
+	/*
+	 * The counters of a port share one or two MDIO pages, read them all in
+	 * one go instead of switching the page for every single register.
+	 */
+	mutex_lock(&bus->mdio_lock);
+
 	mib_stats = &priv->mib_stats[port * priv->chip->num_mibs];
 	for (i = 0; i < priv->chip->num_mibs; i++) {
 		const struct ar8xxx_mib_desc *mib;
@@ -442,11 +459,12 @@ ar8xxx_mib_fetch_port_stat(struct ar8xxx_priv *priv, int port, bool flush)
 		mib = &priv->chip->mib_decs[i];
 		if (mib->type > priv->mib_type)
 			continue;
-		t = ar8xxx_read(priv, base + mib->offset);
+		t = ar8xxx_read_paged(priv, base + mib->offset, &page);
 		if (mib->size == 2) {
 			u64 hi;
 
-			hi = ar8xxx_read(priv, base + mib->offset + 4);
+			hi = ar8xxx_read_paged(priv, base + mib->offset + 4,
+					       &page);
 			t |= hi << 32;
 		}
 
@@ -454,8 +472,42 @@ ar8xxx_mib_fetch_port_stat(struct ar8xxx_priv *priv, int port, bool flush)
 			mib_stats[i] = 0;
 		else
 			mib_stats[i] += t;
-		cond_resched();
 	}
+
+	mutex_unlock(&bus->mdio_lock);
+
+	priv->mib_pending &= ~BIT(port);
+}
+
+/*
+ * The hardware only keeps the counters of the last capture. Fetch the ports
+ * which have not been read since then first, so that their counts are not
+ * lost by taking a new snapshot.
+ */
+static int
+ar8xxx_mib_capture(struct ar8xxx_priv *priv)
+{
+	int ret, i;
+
+	for (i = 0; i < priv->dev.ports; i++)
+		if (priv->mib_pending & BIT(i))
+			ar8xxx_mib_fetch_port_stat(priv, i, false);
+
+	ret = ar8xxx_mib_op(priv, AR8216_MIB_FUNC_CAPTURE);
+	if (ret)
+		return ret;
+
+	priv->mib_pending = BIT(priv->dev.ports) - 1;
+
+	return 0;
+}
+
+static int
+ar8xxx_mib_flush(struct ar8xxx_priv *priv)
+{
+	priv->mib_pending = 0;
+
+	return ar8xxx_mib_op(priv, AR8216_MIB_FUNC_FLUSH);
 }
 
 static void
@@ -2286,27 +2338,42 @@ ar8xxx_id_chip(struct ar8xxx_priv *priv)
 	return 0;
 }
 
+/*
+ * Counters are captured once per poll interval, but the ports are read out
+ * one at a time, spread evenly over the interval. This keeps the MDIO bus
+ * free for other users in between.
+ */
+static unsigned long
+ar8xxx_mib_poll_delay(struct ar8xxx_priv *priv)
+{
+	unsigned long delay;
+
+	delay = msecs_to_jiffies(priv->mib_poll_interval) / priv->dev.ports;
+
+	return max(delay, 1UL);
+}
+
 static void
 ar8xxx_mib_work_func(struct work_struct *work)
 {
 	struct ar8xxx_priv *priv;
-	int err, i;
+	int err;
 
 	priv = container_of(work, struct ar8xxx_priv, mib_work.work);
 
 	mutex_lock(&priv->mib_lock);
 
-	err = ar8xxx_mib_capture(priv);
-	if (err)
-		goto next_attempt;
+	if (!priv->mib_pending) {
+		err = ar8xxx_mib_capture(priv);
+		if (err)
+			goto next_attempt;
+	}
 
-	for (i = 0; i < priv->dev.ports; i++)
-		ar8xxx_mib_fetch_port_stat(priv, i, false);
+	ar8xxx_mib_fetch_port_stat(priv, __ffs(priv->mib_pending), false);
 
 next_attempt:
 	mutex_unlock(&priv->mib_lock);
-	schedule_delayed_work(&priv->mib_work,
-			      msecs_to_jiffies(priv->mib_poll_interval));
+	schedule_delayed_work(&priv->mib_work, ar8xxx_mib_poll_delay(priv));
 }
 
 static int
@@ -2335,8 +2402,7 @@ ar8xxx_mib_start(struct ar8xxx_priv *priv)
 	if (!ar8xxx_has_mib_counters(priv) || !priv->mib_poll_interval)
 		return;
 
-	schedule_delayed_work(&priv->mib_work,
-			      msecs_to_jiffies(priv->mib_poll_interval));
+	schedule_delayed_work(&priv->mib_work, ar8xxx_mib_poll_delay(priv));
 }
 
 static void
@@ -501,6 +501,8 @@ struct ar8xxx_priv {
 	u64 *mib_stats;
 	u32 mib_poll_interval;
 	u8 mib_type;
+	/* ports whose counters have not been read since the last capture */
+	u32 mib_pending;
 
 	struct list_head list;
 	unsigned int use_count;
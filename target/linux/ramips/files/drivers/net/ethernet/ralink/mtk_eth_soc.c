@@ -32,6 +32,7 @@
 #include <linux/bug.h>
 #include <linux/netfilter.h>
 #include <net/netfilter/nf_flow_table.h>
+#include <net/page_pool/helpers.h>
 #include <linux/of_gpio.h>
 #include <linux/gpio.h>
 #include <linux/gpio/consumer.h>
@@ -215,22 +216,50 @@ static inline void fe_set_txd(struct fe_tx_dma *txd, struct fe_tx_dma *dma_txd)
 	dma_txd->txd2 = txd->txd2;
 }
 
-static void fe_clean_rx(struct fe_priv *priv)
+static u8 *fe_alloc_rx_buf(struct fe_priv *priv, dma_addr_t *dma_addr,
+			   gfp_t gfp)
 {
 	struct fe_rx_ring *ring = &priv->rx_ring;
+	unsigned int offset;
 	struct page *page;
+	int pad;
+
+	if (priv->flags & FE_FLAG_RX_2B_OFFSET)
+		pad = 0;
+	else
+		pad = NET_IP_ALIGN;
+
+	page = page_pool_alloc_frag(ring->page_pool, &offset, ring->frag_size,
+				    gfp);
+	if (unlikely(!page))
+		return NULL;
+
+	/* the pool keeps its pages mapped, only hand the part the dma
+	 * engine may write back to the device
+	 */
+	*dma_addr = page_pool_get_dma_addr(page) + offset + NET_SKB_PAD + pad;
+	dma_sync_single_for_device(priv->dev, *dma_addr, ring->rx_buf_size,
+				   DMA_FROM_DEVICE);
+
+	return page_address(page) + offset;
+}
+
+static void fe_free_rx_buf(struct fe_rx_ring *ring, u8 *data,
+			   bool allow_direct)
+{
+	page_pool_put_full_page(ring->page_pool, virt_to_head_page(data),
+				allow_direct);
+}
+
+static void fe_clean_rx(struct fe_priv *priv)
+{
+	struct fe_rx_ring *ring = &priv->rx_ring;
 	int i;
 
 	if (ring->rx_data) {
 		for (i = 0; i < ring->rx_ring_size; i++)
-			if (ring->rx_data[i]) {
-				if (ring->rx_dma && ring->rx_dma[i].rxd1)
-					dma_unmap_single(priv->dev,
-							 ring->rx_dma[i].rxd1,
-							 ring->rx_buf_size,
-							 DMA_FROM_DEVICE);
-				skb_free_frag(ring->rx_data[i]);
-			}
+			if (ring->rx_data[i])
+				fe_free_rx_buf(ring, ring->rx_data[i], false);
 
 		kfree(ring->rx_data);
 		ring->rx_data = NULL;
@@ -244,32 +273,35 @@ static void fe_clean_rx(struct fe_priv *priv)
 		ring->rx_dma = NULL;
 	}
 
-	if (!ring->frag_cache.va)
-	    return;
-
-	page = virt_to_page(ring->frag_cache.va);
-	__page_frag_cache_drain(page, ring->frag_cache.pagecnt_bias);
-	memset(&ring->frag_cache, 0, sizeof(ring->frag_cache));
+	if (ring->page_pool) {
+		page_pool_destroy(ring->page_pool);
+		ring->page_pool = NULL;
+	}
 }
 
 static int fe_alloc_rx(struct fe_priv *priv)
 {
 	struct fe_rx_ring *ring = &priv->rx_ring;
-	int i, pad;
+	struct page_pool_params pp_params = {
+		.flags = PP_FLAG_DMA_MAP | PP_FLAG_PAGE_FRAG,
+		.pool_size = ring->rx_ring_size,
+		.nid = NUMA_NO_NODE,
+		.dev = priv->dev,
+		.dma_dir = DMA_FROM_DEVICE,
+	};
+	struct page_pool *pp;
+	int i;
+
+	pp = page_pool_create(&pp_params);
+	if (IS_ERR(pp))
+		goto no_rx_mem;
+	ring->page_pool = pp;
 
 	ring->rx_data = kcalloc(ring->rx_ring_size, sizeof(*ring->rx_data),
 			GFP_KERNEL);
 	if (!ring->rx_data)
 		goto no_rx_mem;
 
-	for (i = 0; i < ring->rx_ring_size; i++) {
-		ring->rx_data[i] = page_frag_alloc(&ring->frag_cache,
-						   ring->frag_size,
-						   GFP_KERNEL);
-		if (!ring->rx_data[i])
-			goto no_rx_mem;
-	}
-
 	ring->rx_dma = dma_alloc_coherent(priv->dev,
 			ring->rx_ring_size * sizeof(*ring->rx_dma),
 			&ring->rx_phys,
@@ -277,16 +309,11 @@ static int fe_alloc_rx(struct fe_priv *priv)
 	if (!ring->rx_dma)
 		goto no_rx_mem;
 
-	if (priv->flags & FE_FLAG_RX_2B_OFFSET)
-		pad = 0;
-	else
-		pad = NET_IP_ALIGN;
 	for (i = 0; i < ring->rx_ring_size; i++) {
-		dma_addr_t dma_addr = dma_map_single(priv->dev,
-				ring->rx_data[i] + NET_SKB_PAD + pad,
-				ring->rx_buf_size,
-				DMA_FROM_DEVICE);
-		if (unlikely(dma_mapping_error(priv->dev, dma_addr)))
+		dma_addr_t dma_addr;
+
+		ring->rx_data[i] = fe_alloc_rx_buf(priv, &dma_addr, GFP_KERNEL);
+		if (!ring->rx_data[i])
 			goto no_rx_mem;
 		ring->rx_dma[i].rxd1 = (unsigned int)dma_addr;
 
@@ -871,18 +898,13 @@ static int fe_poll_rx(struct napi_struct *napi, int budget,
 	struct sk_buff *skb;
 	u8 *data, *new_data;
 	struct fe_rx_dma *rxd, trxd;
-	int done = 0, pad;
+	int done = 0;
 
 	if (netdev->features & NETIF_F_RXCSUM)
 		checksum_bit = soc->checksum_bit;
 	else
 		checksum_bit = 0;
 
-	if (priv->flags & FE_FLAG_RX_2B_OFFSET)
-		pad = 0;
-	else
-		pad = NET_IP_ALIGN;
-
 	while (done < budget) {
 		unsigned int pktlen;
 		dma_addr_t dma_addr;
@@ -895,33 +917,33 @@ static int fe_poll_rx(struct napi_struct *napi, int budget,
 		if (!(trxd.rxd2 & RX_DMA_DONE))
 			break;
 
-		/* alloc new buffer */
-		new_data = page_frag_alloc(&ring->frag_cache, ring->frag_size,
-					   GFP_ATOMIC);
+		/* alloc new buffer, the old one stays in the ring if this
+		 * fails and is handed back to the dma engine as is
+		 */
+		new_data = fe_alloc_rx_buf(priv, &dma_addr, GFP_ATOMIC);
 		if (unlikely(!new_data)) {
 			stats->rx_dropped++;
 			goto release_desc;
 		}
-		dma_addr = dma_map_single(priv->dev,
-					  new_data + NET_SKB_PAD + pad,
-					  ring->rx_buf_size,
-					  DMA_FROM_DEVICE);
-		if (unlikely(dma_mapping_error(priv->dev, dma_addr))) {
-			skb_free_frag(new_data);
-			goto release_desc;
-		}
 
 		/* receive data */
-		skb = build_skb(data, ring->frag_size);
+		skb = napi_build_skb(data, ring->frag_size);
 		if (unlikely(!skb)) {
-			skb_free_frag(new_data);
+			fe_free_rx_buf(ring, new_data, true);
 			goto release_desc;
 		}
+		skb_mark_for_recycle(skb);
 		skb_reserve(skb, NET_SKB_PAD + NET_IP_ALIGN);
 
-		dma_unmap_single(priv->dev, trxd.rxd1,
-				 ring->rx_buf_size, DMA_FROM_DEVICE);
 		pktlen = RX_DMA_GET_PLEN0(trxd.rxd2);
+		/* with the 2 byte offset the frame starts behind rxd1 */
+		if (priv->flags & FE_FLAG_RX_2B_OFFSET)
+			dma_sync_single_for_cpu(priv->dev, trxd.rxd1,
+						pktlen + NET_IP_ALIGN,
+						DMA_FROM_DEVICE);
+		else
+			dma_sync_single_for_cpu(priv->dev, trxd.rxd1, pktlen,
+						DMA_FROM_DEVICE);
 		skb->dev = netdev;
 		skb_put(skb, pktlen);
 		if (trxd.rxd4 & checksum_bit)
@@ -950,12 +972,15 @@ release_desc:
 			rxd->rxd2 = RX_DMA_LSO;
 
 		ring->rx_calc_idx = idx;
-		/* make sure that all changes to the dma ring are flushed before
-		 * we continue
+		done++;
+	}
+
+	if (done) {
+		/* make sure that all changes to the dma ring are flushed
+		 * before we hand the refilled descriptors to the hardware
 		 */
 		wmb();
 		fe_reg_w32(ring->rx_calc_idx, FE_REG_RX_CALC_IDX0);
-		done++;
 	}
 
 	if (done < budget)
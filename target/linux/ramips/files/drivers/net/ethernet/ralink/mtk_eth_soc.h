@@ -451,7 +451,7 @@ struct fe_tx_ring {
 };
 
 struct fe_rx_ring {
-	struct page_frag_cache frag_cache;
+	struct page_pool *page_pool;
 	struct fe_rx_dma *rx_dma;
 	u8 **rx_data;
 	dma_addr_t rx_phys;
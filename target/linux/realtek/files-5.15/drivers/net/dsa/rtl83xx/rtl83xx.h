@@ -78,6 +78,9 @@ void __init rtl83xx_setup_qos(struct rtl838x_switch_priv *priv);
 int rtl83xx_packet_cntr_alloc(struct rtl838x_switch_priv *priv);
 
 int rtl83xx_port_is_under(const struct net_device * dev, struct rtl838x_switch_priv *priv);
+int rtl83xx_l3_flow_add(struct rtl838x_switch_priv *priv, struct rtl83xx_flow *flow,
+			u64 smac, u64 dmac, int port, int vlan);
+void rtl83xx_l3_flow_del(struct rtl838x_switch_priv *priv, struct rtl83xx_flow *flow);
 
 int read_phy(u32 port, u32 page, u32 reg, u32 *val);
 int write_phy(u32 port, u32 page, u32 reg, u32 val);
@@ -3,6 +3,8 @@
 #include <linux/of_mdio.h>
 #include <linux/of_platform.h>
 #include <net/arp.h>
+#include <net/ip6_fib.h>
+#include <net/ndisc.h>
 #include <net/nexthop.h>
 #include <net/neighbour.h>
 #include <net/netevent.h>
@@ -692,6 +694,56 @@ int rtl83xx_l2_nexthop_rm(struct rtl838x_switch_priv *priv, struct rtl83xx_nexth
 	return 0;
 }
 
+/* Returns a route or offloaded flow other than r that uses the same L2 nexthop
+ * entry. Routes only hold one once they forward to their resolved gateway.
+ * Called with l3_lock held.
+ */
+static struct rtl83xx_route *rtl83xx_l2_nexthop_user(struct rtl838x_switch_priv *priv,
+						     struct rtl83xx_route *r)
+{
+	struct rtl83xx_route *e;
+
+	list_for_each_entry(e, &priv->route_list, list) {
+		if (e != r && e->attr.valid && e->attr.action == ROUTE_ACT_FORWARD &&
+		    e->nh.l2_id == r->nh.l2_id)
+			return e;
+	}
+
+	list_for_each_entry(e, &priv->flow_routes, list) {
+		if (e != r && e->nh.l2_id == r->nh.l2_id)
+			return e;
+	}
+
+	return NULL;
+}
+
+/* Sets up the L2 nexthop entry for the gateway of a route or offloaded flow,
+ * which may already be in use by other routes and flows.
+ */
+static int rtl83xx_route_nexthop_get(struct rtl838x_switch_priv *priv, struct rtl83xx_route *r)
+{
+	struct rtl83xx_route *e;
+	int err;
+
+	err = rtl83xx_l2_nexthop_add(priv, &r->nh);
+	if (err)
+		return err;
+
+	/* The VID of a shared entry was replaced by the route ID of its first user */
+	e = rtl83xx_l2_nexthop_user(priv, r);
+	if (e)
+		r->nh.vid = e->nh.vid;
+
+	return 0;
+}
+
+/* Releases the L2 nexthop entry of a route or flow once nothing else uses it */
+static void rtl83xx_route_nexthop_put(struct rtl838x_switch_priv *priv, struct rtl83xx_route *r)
+{
+	if (!rtl83xx_l2_nexthop_user(priv, r))
+		rtl83xx_l2_nexthop_rm(priv, &r->nh);
+}
+
 static int rtl83xx_handle_changeupper(struct rtl838x_switch_priv *priv,
 				      struct net_device *ndev,
 				      struct netdev_notifier_changeupper_info *info)
@@ -799,80 +851,130 @@ const static struct rhashtable_params route_ht_params = {
 	.head_offset = offsetof(struct rtl83xx_route, linkage),
 };
 
-/* Updates an L3 next hop entry in the ROUTING table */
-static int rtl83xx_l3_nexthop_update(struct rtl838x_switch_priv *priv,  __be32 ip_addr, u64 mac)
-{
-	struct rtl83xx_route *r;
-	struct rhlist_head *tmp, *list;
-
-	rcu_read_lock();
-	list = rhltable_lookup(&priv->routes, &ip_addr, route_ht_params);
-	if (!list) {
-		rcu_read_unlock();
-		return -ENOENT;
-	}
+const static struct rhashtable_params route6_ht_params = {
+	.key_len     = sizeof(struct in6_addr),
+	.key_offset  = offsetof(struct rtl83xx_route, gw_ip6),
+	.head_offset = offsetof(struct rtl83xx_route, linkage),
+};
 
-	rhl_for_each_entry_rcu(r, tmp, list, linkage) {
-		pr_info("%s: Setting up fwding: ip %pI4, GW mac %016llx\n",
-			__func__, &ip_addr, mac);
+/* Sets up forwarding for a route once the MAC address of its gateway is known */
+static void rtl83xx_l3_route_update(struct rtl838x_switch_priv *priv,
+				    struct rtl83xx_route *r, u64 mac)
+{
+	/* Nothing to do if the route already forwards to this gateway MAC */
+	if (r->attr.valid && r->attr.action == ROUTE_ACT_FORWARD && r->nh.gw == mac)
+		return;
 
-		/* Reads the ROUTING table entry associated with the route */
-		priv->r->route_read(r->id, r);
+	if (r->is_ipv6)
+		pr_info("Route with id %d to %pI6 / %d\n", r->id, &r->dst_ip6, r->prefix_len);
+	else
 		pr_info("Route with id %d to %pI4 / %d\n", r->id, &r->dst_ip, r->prefix_len);
 
-		r->nh.mac = r->nh.gw = mac;
-		r->nh.port = priv->port_ignore;
-		r->nh.id = r->id;
+	/* Release the nexthop of the previous gateway MAC */
+	if (r->attr.valid && r->attr.action == ROUTE_ACT_FORWARD)
+		rtl83xx_route_nexthop_put(priv, r);
 
-		/* Do we need to explicitly add a DMAC entry with the route's nh index? */
-		if (priv->r->set_l3_egress_mac)
-			priv->r->set_l3_egress_mac(r->id, mac);
+	r->nh.mac = r->nh.gw = mac;
+	r->nh.port = priv->port_ignore;
+	r->nh.id = r->id;
 
-		/* Update ROUTING table: map gateway-mac and switch-mac id to route id */
-		rtl83xx_l2_nexthop_add(priv, &r->nh);
+	/* Do we need to explicitly add a DMAC entry with the route's nh index? */
+	if (priv->r->set_l3_egress_mac)
+		priv->r->set_l3_egress_mac(r->id, mac);
 
-		r->attr.valid = true;
-		r->attr.action = ROUTE_ACT_FORWARD;
-		r->attr.type = 0;
-		r->attr.hit = false; /* Reset route-used indicator */
+	/* Update ROUTING table: map gateway-mac and switch-mac id to route id */
+	rtl83xx_route_nexthop_get(priv, r);
 
-		/* Add PIE entry with dst_ip and prefix_len */
+	r->attr.valid = true;
+	r->attr.action = ROUTE_ACT_FORWARD;
+	r->attr.type = r->is_ipv6 ? 2 : 0;
+	r->attr.hit = false; /* Reset route-used indicator */
+
+	/* Add PIE entry with dst_ip and prefix_len */
+	if (r->is_ipv6) {
+		r->pr.is_ipv6 = true;
+		r->pr.dip6 = r->dst_ip6;
+		memset(&r->pr.dip6_m, 0xff, sizeof(r->pr.dip6_m));
+		ipv6_addr_prefix(&r->pr.dip6_m, &r->pr.dip6_m, r->prefix_len);
+	} else {
 		r->pr.dip = r->dst_ip;
 		r->pr.dip_m = inet_make_mask(r->prefix_len);
+	}
 
-		if (r->is_host_route) {
-			int slot = priv->r->find_l3_slot(r, false);
+	if (r->is_host_route) {
+		int slot = priv->r->find_l3_slot(r, true);
 
-			pr_info("%s: Got slot for route: %d\n", __func__, slot);
+		if (slot < 0)
+			slot = priv->r->find_l3_slot(r, false);
+		pr_info("%s: Got slot for route: %d\n", __func__, slot);
+		if (slot >= 0)
 			priv->r->host_route_write(slot, r);
-		} else {
-			priv->r->route_write(r->id, r);
-			r->pr.fwd_sel = true;
-			r->pr.fwd_data = r->nh.l2_id;
-			r->pr.fwd_act = PIE_ACT_ROUTE_UC;
+	} else {
+		priv->r->route_write(r->id, r);
+		r->pr.fwd_sel = true;
+		r->pr.fwd_data = r->nh.l2_id;
+		r->pr.fwd_act = PIE_ACT_ROUTE_UC;
+	}
+
+	if (priv->r->set_l3_nexthop)
+		priv->r->set_l3_nexthop(r->nh.id, r->nh.l2_id, r->nh.if_id);
+
+	if (r->pr.id < 0) {
+		r->pr.packet_cntr = rtl83xx_packet_cntr_alloc(priv);
+		if (r->pr.packet_cntr >= 0) {
+			pr_info("Using packet counter %d\n", r->pr.packet_cntr);
+			r->pr.log_sel = true;
+			r->pr.log_data = r->pr.packet_cntr;
 		}
+		priv->r->pie_rule_add(priv, &r->pr);
+	} else {
+		int pkts = priv->r->packet_cntr_read(r->pr.packet_cntr);
+		pr_info("%s: total packets: %d\n", __func__, pkts);
 
-		if (priv->r->set_l3_nexthop)
-			priv->r->set_l3_nexthop(r->nh.id, r->nh.l2_id, r->nh.if_id);
+		priv->r->pie_rule_write(priv, r->pr.id, &r->pr);
+	}
+}
 
-		if (r->pr.id < 0) {
-			r->pr.packet_cntr = rtl83xx_packet_cntr_alloc(priv);
-			if (r->pr.packet_cntr >= 0) {
-				pr_info("Using packet counter %d\n", r->pr.packet_cntr);
-				r->pr.log_sel = true;
-				r->pr.log_data = r->pr.packet_cntr;
-			}
-			priv->r->pie_rule_add(priv, &r->pr);
-		} else {
-			int pkts = priv->r->packet_cntr_read(r->pr.packet_cntr);
-			pr_info("%s: total packets: %d\n", __func__, pkts);
+/* Updates the L3 next hop entries of all IPv4 routes using the gateway ip_addr.
+ * Called with l3_lock held, which protects route_list. Updating a route takes
+ * reg_mutex, so the routes are not looked up under rcu_read_lock().
+ */
+static int rtl83xx_l3_nexthop_update(struct rtl838x_switch_priv *priv,  __be32 ip_addr, u64 mac)
+{
+	struct rtl83xx_route *r;
+	int err = -ENOENT;
 
-			priv->r->pie_rule_write(priv, r->pr.id, &r->pr);
-		}
+	list_for_each_entry(r, &priv->route_list, list) {
+		if (r->is_ipv6 || r->gw_ip != ip_addr)
+			continue;
+
+		pr_info("%s: Setting up fwding: ip %pI4, GW mac %016llx\n",
+			__func__, &ip_addr, mac);
+		rtl83xx_l3_route_update(priv, r, mac);
+		err = 0;
 	}
-	rcu_read_unlock();
 
-	return 0;
+	return err;
+}
+
+/* Same as above for the IPv6 routes using the gateway ip6_addr */
+static int rtl83xx_l3_nexthop6_update(struct rtl838x_switch_priv *priv,
+				      const struct in6_addr *ip6_addr, u64 mac)
+{
+	struct rtl83xx_route *r;
+	int err = -ENOENT;
+
+	list_for_each_entry(r, &priv->route_list, list) {
+		if (!r->is_ipv6 || !ipv6_addr_equal(&r->gw_ip6, ip6_addr))
+			continue;
+
+		pr_info("%s: Setting up fwding: ip %pI6, GW mac %016llx\n",
+			__func__, ip6_addr, mac);
+		rtl83xx_l3_route_update(priv, r, mac);
+		err = 0;
+	}
+
+	return err;
 }
 
 static int rtl83xx_port_ipv4_resolve(struct rtl838x_switch_priv *priv,
@@ -906,6 +1008,35 @@ static int rtl83xx_port_ipv4_resolve(struct rtl838x_switch_priv *priv,
 	return err;
 }
 
+static int rtl83xx_port_ipv6_resolve(struct rtl838x_switch_priv *priv,
+				     struct net_device *dev, const struct in6_addr *ip6_addr)
+{
+	struct neighbour *n = neigh_lookup(&nd_tbl, ip6_addr, dev);
+	u64 mac;
+
+	if (!n) {
+		n = neigh_create(&nd_tbl, ip6_addr, dev);
+		if (IS_ERR(n))
+			return PTR_ERR(n);
+	}
+
+	/* As for IPv4, install the entry right away if the neighbour is known,
+	 * otherwise start neighbour discovery and wait for the netevent.
+	 */
+	if (n->nud_state & NUD_VALID) {
+		mac = ether_addr_to_u64(n->ha);
+		pr_info("%s: resolved mac: %016llx\n", __func__, mac);
+		rtl83xx_l3_nexthop6_update(priv, ip6_addr, mac);
+	} else {
+		pr_info("%s: need to wait\n", __func__);
+		neigh_event_send(n, NULL);
+	}
+
+	neigh_release(n);
+
+	return 0;
+}
+
 struct rtl83xx_walk_data {
 	struct rtl838x_switch_priv *priv;
 	int port;
@@ -942,7 +1073,28 @@ int rtl83xx_port_dev_lower_find(struct net_device *dev, struct rtl838x_switch_pr
 	return data.port;
 }
 
-static struct rtl83xx_route *rtl83xx_route_alloc(struct rtl838x_switch_priv *priv, u32 ip)
+/* Adds a route to the table of its gateway's address family, IPv6 if ip6 is given */
+static int rtl83xx_route_insert(struct rtl838x_switch_priv *priv, struct rtl83xx_route *r,
+				u32 ip, const struct in6_addr *ip6)
+{
+	int err;
+
+	if (ip6) {
+		r->gw_ip6 = *ip6;
+		r->is_ipv6 = true;
+		err = rhltable_insert(&priv->routes6, &r->linkage, route6_ht_params);
+	} else {
+		r->gw_ip = ip;
+		err = rhltable_insert(&priv->routes, &r->linkage, route_ht_params);
+	}
+	if (!err)
+		list_add_tail(&r->list, &priv->route_list);
+
+	return err;
+}
+
+static struct rtl83xx_route *rtl83xx_route_alloc(struct rtl838x_switch_priv *priv, u32 ip,
+						 const struct in6_addr *ip6)
 {
 	struct rtl83xx_route *r;
 	int idx = 0, err;
@@ -959,11 +1111,10 @@ static struct rtl83xx_route *rtl83xx_route_alloc(struct rtl838x_switch_priv *pri
 	}
 
 	r->id = idx;
-	r->gw_ip = ip;
 	r->pr.id = -1; /* We still need to allocate a rule in HW */
 	r->is_host_route = false;
 
-	err = rhltable_insert(&priv->routes, &r->linkage, route_ht_params);
+	err = rtl83xx_route_insert(priv, r, ip, ip6);
 	if (err) {
 		pr_err("Could not insert new rule\n");
 		mutex_unlock(&priv->reg_mutex);
@@ -983,7 +1134,8 @@ out_free:
 }
 
 
-static struct rtl83xx_route *rtl83xx_host_route_alloc(struct rtl838x_switch_priv *priv, u32 ip)
+static struct rtl83xx_route *rtl83xx_host_route_alloc(struct rtl838x_switch_priv *priv, u32 ip,
+						      const struct in6_addr *ip6)
 {
 	struct rtl83xx_route *r;
 	int idx = 0, err;
@@ -1004,11 +1156,10 @@ static struct rtl83xx_route *rtl83xx_host_route_alloc(struct rtl838x_switch_priv
 	 */
 	r->id = idx + MAX_ROUTES;
 
-	r->gw_ip = ip;
 	r->pr.id = -1; /* We still need to allocate a rule in HW */
 	r->is_host_route = true;
 
-	err = rhltable_insert(&priv->routes, &r->linkage, route_ht_params);
+	err = rtl83xx_route_insert(priv, r, ip, ip6);
 	if (err) {
 		pr_err("Could not insert new rule\n");
 		mutex_unlock(&priv->reg_mutex);
@@ -1031,16 +1182,23 @@ out_free:
 
 static void rtl83xx_route_rm(struct rtl838x_switch_priv *priv, struct rtl83xx_route *r)
 {
-	int id;
+	int id, err;
 
-	if (rhltable_remove(&priv->routes, &r->linkage, route_ht_params))
+	if (r->is_ipv6)
+		err = rhltable_remove(&priv->routes6, &r->linkage, route6_ht_params);
+	else
+		err = rhltable_remove(&priv->routes, &r->linkage, route_ht_params);
+	if (err)
 		dev_warn(priv->dev, "Could not remove route\n");
+	else
+		list_del(&r->list);
 
 	if (r->is_host_route) {
-		id = priv->r->find_l3_slot(r, false);
+		id = priv->r->find_l3_slot(r, true);
 		pr_debug("%s: Got id for host route: %d\n", __func__, id);
 		r->attr.valid = false;
-		priv->r->host_route_write(id, r);
+		if (id >= 0)
+			priv->r->host_route_write(id, r);
 		clear_bit(r->id - MAX_ROUTES, priv->host_route_use_bm);
 	} else {
 		/* If there is a HW representation of the route, delete it */
@@ -1048,7 +1206,8 @@ static void rtl83xx_route_rm(struct rtl838x_switch_priv *priv, struct rtl83xx_ro
 			id = priv->r->route_lookup_hw(r);
 			pr_info("%s: Got id for prefix route: %d\n", __func__, id);
 			r->attr.valid = false;
-			priv->r->route_write(id, r);
+			if (id >= 0)
+				priv->r->route_write(id, r);
 		}
 		clear_bit(r->id, priv->route_use_bm);
 	}
@@ -1080,7 +1239,8 @@ static int rtl83xx_fib4_del(struct rtl838x_switch_priv *priv,
 	}
 	rcu_read_unlock();
 
-	rtl83xx_l2_nexthop_rm(priv, &r->nh);
+	if (r->attr.valid && r->attr.action == ROUTE_ACT_FORWARD)
+		rtl83xx_route_nexthop_put(priv, r);
 
 	pr_debug("%s: Releasing packet counter %d\n", __func__, r->pr.packet_cntr);
 	set_bit(r->pr.packet_cntr, priv->packet_cntr_use_bm);
@@ -1096,9 +1256,10 @@ static int rtl83xx_fib4_del(struct rtl838x_switch_priv *priv,
 /* On the RTL93xx, an L3 termination endpoint MAC address on which the router waits
  * for packets to be routed needs to be allocated.
  */
-static int rtl83xx_alloc_router_mac(struct rtl838x_switch_priv *priv, u64 mac)
+static int rtl83xx_alloc_router_mac(struct rtl838x_switch_priv *priv, u64 mac, bool *created)
 {
 	int free_mac = -1;
+	bool found = false;
 	struct rtl93xx_rt_mac m;
 
 	mutex_lock(&priv->reg_mutex);
@@ -1110,6 +1271,7 @@ static int rtl83xx_alloc_router_mac(struct rtl838x_switch_priv *priv, u64 mac)
 		}
 		if (m.valid && m.mac == mac) {
 			free_mac = i;
+			found = true;
 			break;
 		}
 	}
@@ -1133,10 +1295,23 @@ static int rtl83xx_alloc_router_mac(struct rtl838x_switch_priv *priv, u64 mac)
 
 	mutex_unlock(&priv->reg_mutex);
 
-	return 0;
+	if (created)
+		*created = !found;
+
+	return free_mac;
+}
+
+static void rtl83xx_free_router_mac(struct rtl838x_switch_priv *priv, int idx)
+{
+	struct rtl93xx_rt_mac m = {};
+
+	mutex_lock(&priv->reg_mutex);
+	priv->r->set_l3_router_mac(idx, &m);
+	mutex_unlock(&priv->reg_mutex);
 }
 
-static int rtl83xx_alloc_egress_intf(struct rtl838x_switch_priv *priv, u64 mac, int vlan)
+static int rtl83xx_alloc_egress_intf(struct rtl838x_switch_priv *priv, u64 mac, int vlan,
+				     bool *created)
 {
 	int free_mac = -1;
 	struct rtl838x_l3_intf intf;
@@ -1151,12 +1326,15 @@ static int rtl83xx_alloc_egress_intf(struct rtl838x_switch_priv *priv, u64 mac,
 		}
 		if (m == mac) {
 			mutex_unlock(&priv->reg_mutex);
+			if (created)
+				*created = false;
 			return i;
 		}
 	}
 
 	if (free_mac < 0) {
 		pr_err("No free egress interface, cannot offload\n");
+		mutex_unlock(&priv->reg_mutex);
 		return -1;
 	}
 
@@ -1175,9 +1353,138 @@ static int rtl83xx_alloc_egress_intf(struct rtl838x_switch_priv *priv, u64 mac,
 
 	mutex_unlock(&priv->reg_mutex);
 
+	if (created)
+		*created = true;
+
 	return free_mac;
 }
 
+/* An egress interface is free when its source MAC is unset */
+static void rtl83xx_free_egress_intf(struct rtl838x_switch_priv *priv, int idx)
+{
+	mutex_lock(&priv->reg_mutex);
+	priv->r->set_l3_egress_mac(L3_EGRESS_DMACS + idx, 0);
+	mutex_unlock(&priv->reg_mutex);
+}
+
+/* Sets up the nexthop for a routed flow offloaded from an nf_flowtable.
+ * The flow's own PIE rule matches the packets, so unlike for a FIB route no
+ * destination prefix is written, only a route ID with the gateway MAC and
+ * its L2 nexthop entry. Flows towards the same gateway share the nexthop.
+ */
+int rtl83xx_l3_flow_add(struct rtl838x_switch_priv *priv, struct rtl83xx_flow *flow,
+			u64 smac, u64 dmac, int port, int vlan)
+{
+	bool new_rmac = false, new_intf = false;
+	struct rtl83xx_route *r;
+	int idx, rmac = -1, err = -ENOSPC;
+
+	if (!priv->r->route_write)
+		return -EOPNOTSUPP;
+
+	/* Flows are added from the flowtable work without RTNL */
+	mutex_lock(&priv->l3_lock);
+
+	list_for_each_entry(r, &priv->flow_routes, list) {
+		if (r->nh.gw == dmac && r->nh.rvid == vlan) {
+			r->flow_refs++;
+			goto out_set_rule;
+		}
+	}
+
+	mutex_lock(&priv->reg_mutex);
+	idx = find_first_zero_bit(priv->route_use_bm, MAX_ROUTES);
+	if (idx < MAX_ROUTES)
+		set_bit(idx, priv->route_use_bm);
+	mutex_unlock(&priv->reg_mutex);
+	if (idx >= MAX_ROUTES)
+		goto out_unlock;
+
+	r = kzalloc(sizeof(*r), GFP_KERNEL);
+	if (!r) {
+		err = -ENOMEM;
+		goto out_release_id;
+	}
+
+	r->id = idx;
+	r->pr.id = -1;
+	r->nh.id = idx;
+	r->nh.mac = r->nh.gw = dmac;
+	r->nh.port = port;
+	r->nh.rvid = vlan;
+
+	if (priv->r->set_l3_router_mac) {
+		rmac = rtl83xx_alloc_router_mac(priv, smac, &new_rmac);
+		if (rmac < 0)
+			goto out_free;
+
+		r->nh.if_id = rtl83xx_alloc_egress_intf(priv, smac, vlan, &new_intf);
+		if (r->nh.if_id < 0)
+			goto out_free_rmac;
+	}
+
+	if (priv->r->set_l3_egress_mac)
+		priv->r->set_l3_egress_mac(r->id, dmac);
+
+	if (rtl83xx_route_nexthop_get(priv, r))
+		goto out_free_intf;
+
+	/* The RTL93xx keep the gateway in the L3_NEXTHOP table, where route_write()
+	 * would install a prefix route. The RTL838x/9x keep it in the ROUTING table.
+	 */
+	if (priv->r->set_l3_nexthop)
+		priv->r->set_l3_nexthop(r->nh.id, r->nh.l2_id, r->nh.if_id);
+	else
+		priv->r->route_write(r->id, r);
+
+	r->flow_refs = 1;
+	list_add_tail(&r->list, &priv->flow_routes);
+
+out_set_rule:
+	flow->route = r;
+	flow->rule.fwd_sel = true;
+	flow->rule.fwd_data = r->nh.l2_id;
+	flow->rule.fwd_act = PIE_ACT_ROUTE_UC;
+	mutex_unlock(&priv->l3_lock);
+
+	return 0;
+
+out_free_intf:
+	if (new_intf)
+		rtl83xx_free_egress_intf(priv, r->nh.if_id);
+out_free_rmac:
+	if (new_rmac)
+		rtl83xx_free_router_mac(priv, rmac);
+out_free:
+	kfree(r);
+out_release_id:
+	clear_bit(idx, priv->route_use_bm);
+out_unlock:
+	mutex_unlock(&priv->l3_lock);
+
+	return err;
+}
+
+/* Drops an offloaded flow's reference on its nexthop, the caller removes the PIE rule */
+void rtl83xx_l3_flow_del(struct rtl838x_switch_priv *priv, struct rtl83xx_flow *flow)
+{
+	struct rtl83xx_route *r = flow->route;
+
+	if (!r)
+		return;
+
+	mutex_lock(&priv->l3_lock);
+	if (!--r->flow_refs) {
+		list_del(&r->list);
+		rtl83xx_route_nexthop_put(priv, r);
+		clear_bit(r->id, priv->route_use_bm);
+		kfree(r);
+	}
+	mutex_unlock(&priv->l3_lock);
+
+	flow->route = NULL;
+}
+
 static int rtl83xx_fib4_add(struct rtl838x_switch_priv *priv,
 			    struct fib_entry_notifier_info *info)
 {
@@ -1219,9 +1526,9 @@ static int rtl83xx_fib4_add(struct rtl838x_switch_priv *priv,
 
 	/* Allocate route or host-route (entry if hardware supports this) */
 	if (info->dst_len == 32 && priv->r->host_route_write)
-		r = rtl83xx_host_route_alloc(priv, nh->fib_nh_gw4);
+		r = rtl83xx_host_route_alloc(priv, nh->fib_nh_gw4, NULL);
 	else
-		r = rtl83xx_route_alloc(priv, nh->fib_nh_gw4);
+		r = rtl83xx_route_alloc(priv, nh->fib_nh_gw4, NULL);
 
 	if (!r) {
 		pr_err("%s: No more free route entries\n", __func__);
@@ -1230,6 +1537,7 @@ static int rtl83xx_fib4_add(struct rtl838x_switch_priv *priv,
 
 	r->dst_ip = info->dst;
 	r->prefix_len = info->dst_len;
+	r->ifindex = dev->ifindex;
 	r->nh.rvid = vlan;
 	to_localhost = !nh->fib_nh_gw4;
 
@@ -1238,11 +1546,11 @@ static int rtl83xx_fib4_add(struct rtl838x_switch_priv *priv,
 
 		pr_debug("Local route and router mac %016llx\n", mac);
 
-		if (rtl83xx_alloc_router_mac(priv, mac))
+		if (rtl83xx_alloc_router_mac(priv, mac, NULL) < 0)
 			goto out_free_rt;
 
 		/* vid = 0: Do not care about VID */
-		r->nh.if_id = rtl83xx_alloc_egress_intf(priv, mac, vlan);
+		r->nh.if_id = rtl83xx_alloc_egress_intf(priv, mac, vlan, NULL);
 		if (r->nh.if_id < 0)
 			goto out_free_rmac;
 
@@ -1274,20 +1582,244 @@ out_free_rt:
 	return 0;
 }
 
+static int rtl83xx_fib6_del(struct rtl838x_switch_priv *priv,
+			    struct fib6_entry_notifier_info *info)
+{
+	struct fib6_info *rt = info->rt;
+	struct fib6_nh *nh = rt->fib6_nh;
+	struct rtl83xx_route *r = NULL, *e;
+	struct rhlist_head *tmp, *list;
+
+	pr_debug("In %s, ip %pI6, len %d\n", __func__, &rt->fib6_dst.addr, rt->fib6_dst.plen);
+	if (rt->nh)
+		return 0;
+
+	rcu_read_lock();
+	list = rhltable_lookup(&priv->routes6, &nh->fib_nh_gw6, route6_ht_params);
+	rhl_for_each_entry_rcu(e, tmp, list, linkage) {
+		if (ipv6_addr_equal(&e->dst_ip6, &rt->fib6_dst.addr) &&
+		    e->prefix_len == rt->fib6_dst.plen) {
+			r = e;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	if (!r) {
+		pr_debug("%s: no such route via %pI6\n", __func__, &nh->fib_nh_gw6);
+		return -ENOENT;
+	}
+
+	/* Only routes whose gateway was resolved have a nexthop and a PIE rule */
+	if (r->pr.id >= 0) {
+		if (r->attr.valid && r->attr.action == ROUTE_ACT_FORWARD)
+			rtl83xx_route_nexthop_put(priv, r);
+
+		pr_debug("%s: Releasing packet counter %d\n", __func__, r->pr.packet_cntr);
+		if (r->pr.packet_cntr >= 0)
+			set_bit(r->pr.packet_cntr, priv->packet_cntr_use_bm);
+		priv->r->pie_rule_rm(priv, &r->pr);
+	}
+
+	rtl83xx_route_rm(priv, r);
+
+	nh->fib_nh_flags &= ~RTNH_F_OFFLOAD;
+
+	return 0;
+}
+
 static int rtl83xx_fib6_add(struct rtl838x_switch_priv *priv,
 			    struct fib6_entry_notifier_info *info)
 {
-	pr_debug("In %s\n", __func__);
-/*	nh->fib_nh_flags |= RTNH_F_OFFLOAD; */
+	struct fib6_info *rt = info->rt;
+	struct fib6_nh *nh = rt->fib6_nh;
+	struct net_device *dev;
+	struct rtl83xx_route *r;
+	bool to_localhost, new_rmac;
+	int addr_type, port, vlan, rmac;
+	u64 mac;
+
+	pr_debug("In %s, ip %pI6, len %d\n", __func__, &rt->fib6_dst.addr, rt->fib6_dst.plen);
+
+	/* IPv6 routes are only offloaded into the RTL93xx L3 tables */
+	if (!priv->r->host_route_write || !priv->r->set_l3_router_mac)
+		return 0;
+
+	/* Routes using nexthop objects or multiple paths are not supported */
+	if (rt->nh || info->nsiblings)
+		return 0;
+
+	if (rt->fib6_type != RTN_UNICAST && rt->fib6_type != RTN_LOCAL)
+		return 0;
+
+	if (!rt->fib6_dst.plen) {
+		pr_info("Not offloading default route for now\n");
+		return 0;
+	}
+
+	/* Do not offload multicast, link-local and loopback destinations */
+	addr_type = ipv6_addr_type(&rt->fib6_dst.addr);
+	if (addr_type & (IPV6_ADDR_MULTICAST | IPV6_ADDR_LINKLOCAL | IPV6_ADDR_LOOPBACK))
+		return 0;
+
+	dev = nh->fib_nh_dev;
+	if (!dev)
+		return 0;
+	vlan = is_vlan_dev(dev) ? vlan_dev_vlan_id(dev) : 0;
+
+	pr_debug("GW: %pI6, interface name %s, mac %016llx, vlan %d\n", &nh->fib_nh_gw6,
+		 dev->name, ether_addr_to_u64(dev->dev_addr), vlan);
+
+	port = rtl83xx_port_dev_lower_find(dev, priv);
+	if (port < 0)
+		return -1;
+
+	if (rt->fib6_dst.plen == 128)
+		r = rtl83xx_host_route_alloc(priv, 0, &nh->fib_nh_gw6);
+	else
+		r = rtl83xx_route_alloc(priv, 0, &nh->fib_nh_gw6);
+
+	if (!r) {
+		pr_err("%s: No more free route entries\n", __func__);
+		return -1;
+	}
+
+	r->dst_ip6 = rt->fib6_dst.addr;
+	r->prefix_len = rt->fib6_dst.plen;
+	r->ifindex = dev->ifindex;
+	r->nh.rvid = vlan;
+	r->attr.type = 2;
+	to_localhost = !nh->fib_nh_gw_family;
+
+	/* The router MAC and egress interface are shared with IPv4 routes */
+	mac = ether_addr_to_u64(dev->dev_addr);
+	rmac = rtl83xx_alloc_router_mac(priv, mac, &new_rmac);
+	if (rmac < 0)
+		goto out_free_rt;
+
+	r->nh.if_id = rtl83xx_alloc_egress_intf(priv, mac, vlan, NULL);
+	if (r->nh.if_id < 0)
+		goto out_free_rmac;
+
+	if (to_localhost) {
+		r->nh.mac = mac;
+		r->nh.port = priv->port_ignore;
+		r->attr.valid = true;
+		r->attr.action = ROUTE_ACT_TRAP2CPU;
+
+		if (r->is_host_route) {
+			int slot = priv->r->find_l3_slot(r, false);
+
+			pr_debug("%s: Got slot for route: %d\n", __func__, slot);
+			if (slot >= 0)
+				priv->r->host_route_write(slot, r);
+		} else {
+			priv->r->route_write(r->id, r);
+		}
+	} else {
+		/* We need to resolve the mac address of the GW */
+		rtl83xx_port_ipv6_resolve(priv, dev, &nh->fib_nh_gw6);
+	}
+
+	nh->fib_nh_flags |= RTNH_F_OFFLOAD;
+
+	return 0;
+
+out_free_rmac:
+	if (new_rmac)
+		rtl83xx_free_router_mac(priv, rmac);
+out_free_rt:
+	rtl83xx_route_rm(priv, r);
 
 	return 0;
 }
 
+/* The SoC sets the hit bit of a route whenever it forwards a packet along it. Such
+ * packets never reach the kernel, so the neighbour entry of the gateway would go
+ * stale and be purged although traffic is flowing. Returns whether the route was
+ * used since the last call and clears the hit bit.
+ */
+static bool rtl83xx_route_hit(struct rtl838x_switch_priv *priv, struct rtl83xx_route *r)
+{
+	struct rtl83xx_route hw;
+	int idx;
+
+	if (!r->attr.valid || r->attr.action != ROUTE_ACT_FORWARD)
+		return false;
+
+	memset(&hw, 0, sizeof(hw));
+	if (r->is_host_route) {
+		idx = priv->r->find_l3_slot(r, true);
+		if (idx < 0)
+			return false;
+		priv->r->host_route_read(idx, &hw);
+	} else {
+		idx = r->id;
+		priv->r->route_read(idx, &hw);
+	}
+
+	if (!hw.attr.valid || !hw.attr.hit)
+		return false;
+
+	/* Rewrite the entry from our copy, which always has the hit bit cleared */
+	r->attr.hit = false;
+	if (r->is_host_route)
+		priv->r->host_route_write(idx, r);
+	else
+		priv->r->route_write(idx, r);
+
+	return true;
+}
+
+/* Confirm the gateway neighbour of a route that is in use, the same way the kernel
+ * does for traffic it forwards itself.
+ */
+static void rtl83xx_route_neigh_touch(struct rtl83xx_route *r)
+{
+	struct net_device *dev;
+	struct neighbour *n;
+
+	dev = __dev_get_by_index(&init_net, r->ifindex);
+	if (!dev)
+		return;
+
+	if (IS_ENABLED(CONFIG_IPV6) && r->is_ipv6)
+		n = neigh_lookup(&nd_tbl, &r->gw_ip6, dev);
+	else
+		n = neigh_lookup(&arp_tbl, &r->gw_ip, dev);
+	if (!n)
+		return;
+
+	neigh_event_send(n, NULL);
+	neigh_release(n);
+}
+
+static void rtl83xx_route_aging_work_do(struct work_struct *work)
+{
+	struct rtl838x_switch_priv *priv =
+		container_of(to_delayed_work(work), struct rtl838x_switch_priv, route_aging_work);
+	struct rtl83xx_route *r;
+
+	/* The route list is only modified with RTNL held */
+	rtnl_lock();
+	mutex_lock(&priv->l3_lock);
+	list_for_each_entry(r, &priv->route_list, list) {
+		if (rtl83xx_route_hit(priv, r))
+			rtl83xx_route_neigh_touch(r);
+	}
+	mutex_unlock(&priv->l3_lock);
+	rtnl_unlock();
+
+	schedule_delayed_work(&priv->route_aging_work, RTL83XX_ROUTE_AGING_INTERVAL);
+}
+
 struct net_event_work {
 	struct work_struct work;
 	struct rtl838x_switch_priv *priv;
 	u64 mac;
+	int family;
 	u32 gw_addr;
+	struct in6_addr gw_addr6;
 };
 
 static void rtl83xx_net_event_work_do(struct work_struct *work)
@@ -1296,7 +1828,15 @@ static void rtl83xx_net_event_work_do(struct work_struct *work)
 		container_of(work, struct net_event_work, work);
 	struct rtl838x_switch_priv *priv = net_work->priv;
 
-	rtl83xx_l3_nexthop_update(priv, net_work->gw_addr, net_work->mac);
+	/* Serialize against route changes done by the FIB work */
+	rtnl_lock();
+	mutex_lock(&priv->l3_lock);
+	if (IS_ENABLED(CONFIG_IPV6) && net_work->family == AF_INET6)
+		rtl83xx_l3_nexthop6_update(priv, &net_work->gw_addr6, net_work->mac);
+	else
+		rtl83xx_l3_nexthop_update(priv, net_work->gw_addr, net_work->mac);
+	mutex_unlock(&priv->l3_lock);
+	rtnl_unlock();
 
 	kfree(net_work);
 }
@@ -1314,7 +1854,7 @@ static int rtl83xx_netevent_event(struct notifier_block *this,
 
 	switch (event) {
 	case NETEVENT_NEIGH_UPDATE:
-		if (n->tbl != &arp_tbl)
+		if (n->tbl != &arp_tbl && !(IS_ENABLED(CONFIG_IPV6) && n->tbl == &nd_tbl))
 			return NOTIFY_DONE;
 		dev = n->dev;
 		port = rtl83xx_port_dev_lower_find(dev, priv);
@@ -1331,7 +1871,11 @@ static int rtl83xx_netevent_event(struct notifier_block *this,
 		net_work->priv = priv;
 
 		net_work->mac = ether_addr_to_u64(n->ha);
-		net_work->gw_addr = *(__be32 *) n->primary_key;
+		net_work->family = n->tbl->family;
+		if (net_work->family == AF_INET6)
+			net_work->gw_addr6 = *(struct in6_addr *) n->primary_key;
+		else
+			net_work->gw_addr = *(__be32 *) n->primary_key;
 
 		pr_debug("%s: updating neighbour on port %d, mac %016llx\n",
 			__func__, port, net_work->mac);
@@ -1364,25 +1908,34 @@ static void rtl83xx_fib_event_work_do(struct work_struct *work)
 	struct fib_rule *rule;
 	int err;
 
-	/* Protect internal structures from changes */
+	/* Protect internal structures from changes, l3_lock also keeps offloaded
+	 * flows from updating the L3 tables meanwhile
+	 */
 	rtnl_lock();
+	mutex_lock(&priv->l3_lock);
 	pr_debug("%s: doing work, event %ld\n", __func__, fib_work->event);
 	switch (fib_work->event) {
 	case FIB_EVENT_ENTRY_ADD:
 	case FIB_EVENT_ENTRY_REPLACE:
 	case FIB_EVENT_ENTRY_APPEND:
-		if (fib_work->is_fib6) {
+		if (IS_ENABLED(CONFIG_IPV6) && fib_work->is_fib6) {
 			err = rtl83xx_fib6_add(priv, &fib_work->fen6_info);
+			fib6_info_release(fib_work->fen6_info.rt);
 		} else {
 			err = rtl83xx_fib4_add(priv, &fib_work->fen_info);
 			fib_info_put(fib_work->fen_info.fi);
 		}
 		if (err)
-			pr_err("%s: FIB4 failed\n", __func__);
+			pr_err("%s: FIB%d failed\n", __func__, fib_work->is_fib6 ? 6 : 4);
 		break;
 	case FIB_EVENT_ENTRY_DEL:
-		rtl83xx_fib4_del(priv, &fib_work->fen_info);
-		fib_info_put(fib_work->fen_info.fi);
+		if (IS_ENABLED(CONFIG_IPV6) && fib_work->is_fib6) {
+			rtl83xx_fib6_del(priv, &fib_work->fen6_info);
+			fib6_info_release(fib_work->fen6_info.rt);
+		} else {
+			rtl83xx_fib4_del(priv, &fib_work->fen_info);
+			fib_info_put(fib_work->fen_info.fi);
+		}
 		break;
 	case FIB_EVENT_RULE_ADD:
 	case FIB_EVENT_RULE_DEL:
@@ -1392,6 +1945,7 @@ static void rtl83xx_fib_event_work_do(struct work_struct *work)
 		fib_rule_put(rule);
 		break;
 	}
+	mutex_unlock(&priv->l3_lock);
 	rtnl_unlock();
 	kfree(fib_work);
 }
@@ -1441,9 +1995,13 @@ static int rtl83xx_fib_event(struct notifier_block *this, unsigned long event, v
 			*/
 			fib_info_hold(fib_work->fen_info.fi);
 
-		} else if (info->family == AF_INET6) {
-			//struct fib6_entry_notifier_info *fen6_info = ptr;
-			pr_warn("%s: FIB_RULE ADD/DEL for IPv6 not supported\n", __func__);
+		} else if (IS_ENABLED(CONFIG_IPV6) && info->family == AF_INET6) {
+			memcpy(&fib_work->fen6_info, ptr, sizeof(fib_work->fen6_info));
+			fib_work->is_fib6 = true;
+			/* As for IPv4, hold the route until the work has run */
+			fib6_info_hold(fib_work->fen6_info.rt);
+		} else {
+			/* Multicast routes are not offloaded */
 			kfree(fib_work);
 			return NOTIFY_DONE;
 		}
@@ -1493,6 +2051,7 @@ static int __init rtl83xx_sw_probe(struct platform_device *pdev)
 	priv->dev = dev;
 
 	mutex_init(&priv->reg_mutex);
+	mutex_init(&priv->l2_shadow_lock);
 
 	priv->family_id = soc_info.family;
 	priv->id = soc_info.id;
@@ -1652,8 +2211,12 @@ static int __init rtl83xx_sw_probe(struct platform_device *pdev)
 		goto err_register_nb;
 	}
 
-	/* Initialize hash table for L3 routing */
+	/* Initialize hash tables for L3 routing */
 	rhltable_init(&priv->routes, &route_ht_params);
+	rhltable_init(&priv->routes6, &route6_ht_params);
+	INIT_LIST_HEAD(&priv->route_list);
+	mutex_init(&priv->l3_lock);
+	INIT_LIST_HEAD(&priv->flow_routes);
 
 	/* Register netevent notifier callback to catch notifications about neighboring
 	 * changes to update nexthop entries for L3 routing.
@@ -1676,6 +2239,11 @@ static int __init rtl83xx_sw_probe(struct platform_device *pdev)
 	if (err)
 		goto err_register_fib_nb;
 
+	/* Keep the gateways of routes forwarded in hardware alive */
+	INIT_DELAYED_WORK(&priv->route_aging_work, rtl83xx_route_aging_work_do);
+	if (priv->r->host_route_read)
+		schedule_delayed_work(&priv->route_aging_work, RTL83XX_ROUTE_AGING_INTERVAL);
+
 	/* TODO: put this into l2_setup() */
 	/* Flood BPDUs to all ports including cpu-port */
 	if (soc_info.family != RTL9300_FAMILY_ID) {
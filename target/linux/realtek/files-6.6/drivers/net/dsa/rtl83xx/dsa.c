@@ -1656,6 +1656,7 @@ static int rtl83xx_port_fdb_add(struct dsa_switch *ds, int port,
 	}
 
 	mutex_lock(&priv->reg_mutex);
+	WRITE_ONCE(priv->l2_shadow_valid, false);
 
 	idx = rtl83xx_find_l2_hash_entry(priv, seed, false, &e);
 
@@ -1695,6 +1696,7 @@ static int rtl83xx_port_fdb_del(struct dsa_switch *ds, int port,
 
 	pr_debug("In %s, mac %llx, vid: %d\n", __func__, mac, vid);
 	mutex_lock(&priv->reg_mutex);
+	WRITE_ONCE(priv->l2_shadow_valid, false);
 
 	idx = rtl83xx_find_l2_hash_entry(priv, seed, true, &e);
 
@@ -1721,42 +1723,115 @@ out:
 	return err;
 }
 
-static int rtl83xx_port_fdb_dump(struct dsa_switch *ds, int port,
-				 dsa_fdb_dump_cb_t *cb, void *data)
+static void rtl83xx_l2_shadow_add(struct rtl838x_switch_priv *priv,
+				  struct rtl838x_l2_entry *e, bool cam)
+{
+	struct rtl838x_l2_shadow_entry *se = &priv->l2_shadow[priv->l2_shadow_count++];
+
+	ether_addr_copy(se->mac, e->mac);
+	se->vid = e->vid;
+	se->port = e->port;
+	se->is_static = e->is_static;
+	se->cam = cam;
+}
+
+static void rtl83xx_l2_shadow_free(void *data)
+{
+	struct rtl838x_switch_priv *priv = data;
+
+	kvfree(priv->l2_shadow);
+	priv->l2_shadow = NULL;
+}
+
+/* Refresh the shadow of the L2 table in a single pass over the hash table
+ * and the CAM, unless it is still recent enough. Called with l2_shadow_lock
+ * held. reg_mutex is only held for a block of entries at a time, so other
+ * switch operations are not stalled during the whole pass.
+ */
+static int rtl83xx_l2_shadow_update(struct rtl838x_switch_priv *priv)
 {
 	struct rtl838x_l2_entry e;
-	struct rtl838x_switch_priv *priv = ds->priv;
+	int err;
+
+	if (READ_ONCE(priv->l2_shadow_valid) &&
+	    time_before(jiffies, priv->l2_shadow_updated + RTL83XX_L2_SHADOW_MAX_AGE))
+		return 0;
+
+	if (!priv->l2_shadow) {
+		priv->l2_shadow = kvcalloc(priv->fib_entries + 64,
+					   sizeof(*priv->l2_shadow), GFP_KERNEL);
+		if (!priv->l2_shadow)
+			return -ENOMEM;
+
+		err = devm_add_action_or_reset(priv->dev, rtl83xx_l2_shadow_free, priv);
+		if (err)
+			return err;
+	}
+
+	/* set before the pass, so that a change during the pass invalidates it */
+	WRITE_ONCE(priv->l2_shadow_valid, true);
+	priv->l2_shadow_count = 0;
 
 	mutex_lock(&priv->reg_mutex);
 
 	for (int i = 0; i < priv->fib_entries; i++) {
 		priv->r->read_l2_entry_using_hash(i >> 2, i & 0x3, &e);
 
-		if (!e.valid)
-			continue;
-
-		if (e.port == port || e.port == RTL930X_PORT_IGNORE)
-			cb(e.mac, e.vid, e.is_static, data);
+		if (e.valid)
+			rtl83xx_l2_shadow_add(priv, &e, false);
 
-		if (!((i + 1) % 64))
+		if (!((i + 1) % 64)) {
+			mutex_unlock(&priv->reg_mutex);
 			cond_resched();
+			mutex_lock(&priv->reg_mutex);
+		}
 	}
 
 	for (int i = 0; i < 64; i++) {
 		priv->r->read_cam(i, &e);
 
-		if (!e.valid)
-			continue;
-
-		if (e.port == port)
-			cb(e.mac, e.vid, e.is_static, data);
+		if (e.valid)
+			rtl83xx_l2_shadow_add(priv, &e, true);
 	}
 
 	mutex_unlock(&priv->reg_mutex);
 
+	/* taken after the pass, so that a slow pass does not use up the max.
+	 * age before the bridge dumps the next port
+	 */
+	priv->l2_shadow_updated = jiffies;
+
 	return 0;
 }
 
+/* The bridge dumps the FDB port by port, serve these from one shadow copy
+ * of the L2 table instead of reading the whole table for every port.
+ */
+static int rtl83xx_port_fdb_dump(struct dsa_switch *ds, int port,
+				 dsa_fdb_dump_cb_t *cb, void *data)
+{
+	struct rtl838x_switch_priv *priv = ds->priv;
+	int err;
+
+	mutex_lock(&priv->l2_shadow_lock);
+
+	err = rtl83xx_l2_shadow_update(priv);
+	if (err)
+		goto out;
+
+	for (int i = 0; i < priv->l2_shadow_count; i++) {
+		struct rtl838x_l2_shadow_entry *se = &priv->l2_shadow[i];
+
+		if (se->port == port || (!se->cam && se->port == RTL930X_PORT_IGNORE))
+			cb(se->mac, se->vid, se->is_static, data);
+	}
+
+out:
+	mutex_unlock(&priv->l2_shadow_lock);
+
+	return err;
+}
+
 static int rtl83xx_port_mdb_add(struct dsa_switch *ds, int port,
 				const struct switchdev_obj_port_mdb *mdb,
 				const struct dsa_db db)
@@ -594,6 +594,12 @@ typedef enum {
 #define MAX_LAGS 16
 #define MAX_PRIOS 8
 #define RTL930X_PORT_IGNORE 0x3f
+
+/* Maximum age of the L2 table shadow used for FDB dumps */
+#define RTL83XX_L2_SHADOW_MAX_AGE	HZ
+/* Interval in which the hit bits of offloaded routes are collected */
+#define RTL83XX_ROUTE_AGING_INTERVAL	(5 * HZ)
+
 #define MAX_MC_GROUPS 512
 #define UNKNOWN_MC_PMASK (MAX_MC_GROUPS - 1)
 #define PIE_BLOCK_SIZE 128
@@ -674,6 +680,15 @@ enum l2_entry_type {
 	IP6_MULTICAST = 4,
 };
 
+/* Condensed copy of a valid L2 table entry, see rtl83xx_port_fdb_dump() */
+struct rtl838x_l2_shadow_entry {
+	u8 mac[6];
+	u16 vid;
+	u8 port;
+	bool is_static;
+	bool cam;
+};
+
 struct rtl838x_l2_entry {
 	u8 mac[6];
 	u16 vid;
@@ -936,6 +951,8 @@ struct rtl83xx_flow {
 	struct rtl838x_switch_priv *priv;
 	struct pie_rule rule;
 	u32 flags;
+	struct rtl83xx_route *route;	/* Nexthop of a flow offloaded from an nf_flowtable */
+	unsigned long lastused;		/* Last time the flow's packet counter moved */
 };
 
 struct rtl93xx_route_attr {
@@ -953,11 +970,16 @@ struct rtl93xx_route_attr {
 struct rtl83xx_route {
 	u32 gw_ip;			/* IP of the route's gateway */
 	u32 dst_ip;			/* IP of the destination net */
+	struct in6_addr gw_ip6;		/* IPv6 gateway, if is_ipv6 is set */
 	struct in6_addr dst_ip6;
 	int prefix_len;			/* Network prefix len of the destination net */
 	bool is_host_route;
+	bool is_ipv6;
 	int id;				/* ID number of this route */
+	int ifindex;			/* Interface through which the gateway is reached */
 	struct rhlist_head linkage;
+	struct list_head list;		/* Entry in priv->route_list, protected by RTNL and l3_lock */
+	int flow_refs;			/* Number of offloaded flows using this nexthop */
 	u16 switch_mac_id;		/* Index into switch's own MACs, RTL839X only */
 	struct rtl83xx_nexthop nh;
 	struct pie_rule pr;
@@ -1047,6 +1069,7 @@ struct rtl838x_reg {
 	void (*packet_cntr_clear)(int counter);
 	void (*route_read)(int idx, struct rtl83xx_route *rt);
 	void (*route_write)(int idx, struct rtl83xx_route *rt);
+	void (*host_route_read)(int idx, struct rtl83xx_route *rt);
 	void (*host_route_write)(int idx, struct rtl83xx_route *rt);
 	int (*l3_setup)(struct rtl838x_switch_priv *priv);
 	void (*set_l3_nexthop)(int idx, u16 dmac_id, u16 interface);
@@ -1085,6 +1108,11 @@ struct rtl838x_switch_priv {
 	u64 irq_mask;
 	u32 fib_entries;
 	int l2_bucket_size;
+	struct mutex l2_shadow_lock;	/* Mutex for the L2 table shadow */
+	struct rtl838x_l2_shadow_entry *l2_shadow;
+	int l2_shadow_count;
+	unsigned long l2_shadow_updated;
+	bool l2_shadow_valid;
 	struct dentry *dbgfs_dir;
 	int n_lags;
 	u64 lags_port_members[MAX_LAGS];
@@ -1104,6 +1132,11 @@ struct rtl838x_switch_priv {
 	unsigned long int octet_cntr_use_bm[MAX_COUNTERS >> 5];
 	unsigned long int packet_cntr_use_bm[MAX_COUNTERS >> 4];
 	struct rhltable routes;
+	struct rhltable routes6;
+	struct list_head route_list;
+	struct delayed_work route_aging_work;
+	struct mutex l3_lock;		/* Serializes L3 table updates of FIB work and offloaded flows */
+	struct list_head flow_routes;
 	unsigned long int route_use_bm[MAX_ROUTES >> 5];
 	unsigned long int host_route_use_bm[MAX_HOST_ROUTES >> 5];
 	struct rtl838x_l3_intf *interfaces[MAX_INTERFACES];
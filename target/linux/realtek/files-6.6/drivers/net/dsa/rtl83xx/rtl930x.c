@@ -1002,58 +1002,59 @@ static u32 rtl930x_l3_hash4(u32 ip, int algorithm, bool move_dip)
 	return hash;
 }
 
-// Currently not used
-// static u32 rtl930x_l3_hash6(struct in6_addr *ip6, int algorithm, bool move_dip)
-// {
-// 	u32 rows[16];
-// 	u32 hash;
-// 	u32 s0, s1, pH;
-
-// 	rows[0] = (HASH_PICK(ip6->s6_addr[0], 6, 2) << 0);
-// 	rows[1] = (HASH_PICK(ip6->s6_addr[0], 0, 6) << 3) | HASH_PICK(ip6->s6_addr[1], 5, 3);
-// 	rows[2] = (HASH_PICK(ip6->s6_addr[1], 0, 5) << 4) | HASH_PICK(ip6->s6_addr[2], 4, 4);
-// 	rows[3] = (HASH_PICK(ip6->s6_addr[2], 0, 4) << 5) | HASH_PICK(ip6->s6_addr[3], 3, 5);
-// 	rows[4] = (HASH_PICK(ip6->s6_addr[3], 0, 3) << 6) | HASH_PICK(ip6->s6_addr[4], 2, 6);
-// 	rows[5] = (HASH_PICK(ip6->s6_addr[4], 0, 2) << 7) | HASH_PICK(ip6->s6_addr[5], 1, 7);
-// 	rows[6] = (HASH_PICK(ip6->s6_addr[5], 0, 1) << 8) | HASH_PICK(ip6->s6_addr[6], 0, 8);
-// 	rows[7] = (HASH_PICK(ip6->s6_addr[7], 0, 8) << 1) | HASH_PICK(ip6->s6_addr[8], 7, 1);
-// 	rows[8] = (HASH_PICK(ip6->s6_addr[8], 0, 7) << 2) | HASH_PICK(ip6->s6_addr[9], 6, 2);
-// 	rows[9] = (HASH_PICK(ip6->s6_addr[9], 0, 6) << 3) | HASH_PICK(ip6->s6_addr[10], 5, 3);
-// 	rows[10] = (HASH_PICK(ip6->s6_addr[10], 0, 5) << 4) | HASH_PICK(ip6->s6_addr[11], 4, 4);
-// 	if (!algorithm) {
-// 		rows[11] = (HASH_PICK(ip6->s6_addr[11], 0, 4) << 5) |
-// 		           (HASH_PICK(ip6->s6_addr[12], 3, 5) << 0);
-// 		rows[12] = (HASH_PICK(ip6->s6_addr[12], 0, 3) << 6) |
-// 		           (HASH_PICK(ip6->s6_addr[13], 2, 6) << 0);
-// 		rows[13] = (HASH_PICK(ip6->s6_addr[13], 0, 2) << 7) |
-// 		           (HASH_PICK(ip6->s6_addr[14], 1, 7) << 0);
-// 		if (!move_dip) {
-// 			rows[14] = (HASH_PICK(ip6->s6_addr[14], 0, 1) << 8) |
-// 			           (HASH_PICK(ip6->s6_addr[15], 0, 8) << 0);
-// 		}
-// 		hash = rows[0] ^ rows[1] ^ rows[2] ^ rows[3] ^ rows[4] ^
-// 		       rows[5] ^ rows[6] ^ rows[7] ^ rows[8] ^ rows[9] ^
-// 		       rows[10] ^ rows[11] ^ rows[12] ^ rows[13] ^ rows[14];
-// 	} else {
-// 		rows[11] = (HASH_PICK(ip6->s6_addr[11], 0, 4) << 5);
-// 		rows[12] = (HASH_PICK(ip6->s6_addr[12], 3, 5) << 0);
-// 		rows[13] = (HASH_PICK(ip6->s6_addr[12], 0, 3) << 6) |
-// 		           HASH_PICK(ip6->s6_addr[13], 2, 6);
-// 		rows[14] = (HASH_PICK(ip6->s6_addr[13], 0, 2) << 7) |
-// 		           HASH_PICK(ip6->s6_addr[14], 1, 7);
-// 		if (!move_dip) {
-// 			rows[15] = (HASH_PICK(ip6->s6_addr[14], 0, 1) << 8) |
-// 			           (HASH_PICK(ip6->s6_addr[15], 0, 8) << 0);
-// 		}
-// 		s0 = rows[12] + rows[13] + rows[14];
-// 		s1 = (s0 & 0x1ff) + ((s0 & (0x1ff << 9)) >> 9);
-// 		pH = (s1 & 0x1ff) + ((s1 & (0x1ff << 9)) >> 9);
-// 		hash = rows[0] ^ rows[1] ^ rows[2] ^ rows[3] ^ rows[4] ^
-// 		       rows[5] ^ rows[6] ^ rows[7] ^ rows[8] ^ rows[9] ^
-// 		       rows[10] ^ rows[11] ^ pH ^ rows[15];
-// 	}
-// 	return hash;
-// }
+static u32 rtl930x_l3_hash6(struct in6_addr *ip6, int algorithm, bool move_dip)
+{
+	u32 rows[16];
+	u32 hash;
+	u32 s0, s1, pH;
+
+	memset(rows, 0, sizeof(rows));
+
+	rows[0] = (HASH_PICK(ip6->s6_addr[0], 6, 2) << 0);
+	rows[1] = (HASH_PICK(ip6->s6_addr[0], 0, 6) << 3) | HASH_PICK(ip6->s6_addr[1], 5, 3);
+	rows[2] = (HASH_PICK(ip6->s6_addr[1], 0, 5) << 4) | HASH_PICK(ip6->s6_addr[2], 4, 4);
+	rows[3] = (HASH_PICK(ip6->s6_addr[2], 0, 4) << 5) | HASH_PICK(ip6->s6_addr[3], 3, 5);
+	rows[4] = (HASH_PICK(ip6->s6_addr[3], 0, 3) << 6) | HASH_PICK(ip6->s6_addr[4], 2, 6);
+	rows[5] = (HASH_PICK(ip6->s6_addr[4], 0, 2) << 7) | HASH_PICK(ip6->s6_addr[5], 1, 7);
+	rows[6] = (HASH_PICK(ip6->s6_addr[5], 0, 1) << 8) | HASH_PICK(ip6->s6_addr[6], 0, 8);
+	rows[7] = (HASH_PICK(ip6->s6_addr[7], 0, 8) << 1) | HASH_PICK(ip6->s6_addr[8], 7, 1);
+	rows[8] = (HASH_PICK(ip6->s6_addr[8], 0, 7) << 2) | HASH_PICK(ip6->s6_addr[9], 6, 2);
+	rows[9] = (HASH_PICK(ip6->s6_addr[9], 0, 6) << 3) | HASH_PICK(ip6->s6_addr[10], 5, 3);
+	rows[10] = (HASH_PICK(ip6->s6_addr[10], 0, 5) << 4) | HASH_PICK(ip6->s6_addr[11], 4, 4);
+	if (!algorithm) {
+		rows[11] = (HASH_PICK(ip6->s6_addr[11], 0, 4) << 5) |
+		           (HASH_PICK(ip6->s6_addr[12], 3, 5) << 0);
+		rows[12] = (HASH_PICK(ip6->s6_addr[12], 0, 3) << 6) |
+		           (HASH_PICK(ip6->s6_addr[13], 2, 6) << 0);
+		rows[13] = (HASH_PICK(ip6->s6_addr[13], 0, 2) << 7) |
+		           (HASH_PICK(ip6->s6_addr[14], 1, 7) << 0);
+		if (!move_dip) {
+			rows[14] = (HASH_PICK(ip6->s6_addr[14], 0, 1) << 8) |
+			           (HASH_PICK(ip6->s6_addr[15], 0, 8) << 0);
+		}
+		hash = rows[0] ^ rows[1] ^ rows[2] ^ rows[3] ^ rows[4] ^
+		       rows[5] ^ rows[6] ^ rows[7] ^ rows[8] ^ rows[9] ^
+		       rows[10] ^ rows[11] ^ rows[12] ^ rows[13] ^ rows[14];
+	} else {
+		rows[11] = (HASH_PICK(ip6->s6_addr[11], 0, 4) << 5);
+		rows[12] = (HASH_PICK(ip6->s6_addr[12], 3, 5) << 0);
+		rows[13] = (HASH_PICK(ip6->s6_addr[12], 0, 3) << 6) |
+		           HASH_PICK(ip6->s6_addr[13], 2, 6);
+		rows[14] = (HASH_PICK(ip6->s6_addr[13], 0, 2) << 7) |
+		           HASH_PICK(ip6->s6_addr[14], 1, 7);
+		if (!move_dip) {
+			rows[15] = (HASH_PICK(ip6->s6_addr[14], 0, 1) << 8) |
+			           (HASH_PICK(ip6->s6_addr[15], 0, 8) << 0);
+		}
+		s0 = rows[12] + rows[13] + rows[14];
+		s1 = (s0 & 0x1ff) + ((s0 & (0x1ff << 9)) >> 9);
+		pH = (s1 & 0x1ff) + ((s1 & (0x1ff << 9)) >> 9);
+		hash = rows[0] ^ rows[1] ^ rows[2] ^ rows[3] ^ rows[4] ^
+		       rows[5] ^ rows[6] ^ rows[7] ^ rows[8] ^ rows[9] ^
+		       rows[10] ^ rows[11] ^ pH ^ rows[15];
+	}
+	return hash;
+}
 
 /* Read a prefix route entry from the L3_PREFIX_ROUTE_IPUC table
  * We currently only support IPv4 and IPv6 unicast route
@@ -1078,17 +1079,18 @@ static void rtl930x_route_read(int idx, struct rtl83xx_route *rt)
 	v = sw_r32(rtl_table_data(r, 10));
 	host_route = !!(v & BIT(21));
 	default_route = !!(v & BIT(20));
-	rt->prefix_len = -1;
-	pr_info("%s: host route %d, default_route %d\n", __func__, host_route, default_route);
+	pr_debug("%s: host route %d, default_route %d\n", __func__, host_route, default_route);
 
 	switch (rt->attr.type) {
 	case 0: /* IPv4 Unicast route */
 		rt->dst_ip = sw_r32(rtl_table_data(r, 4));
 		ip4_m = sw_r32(rtl_table_data(r, 9));
-		pr_info("%s: Read ip4 mask: %08x\n", __func__, ip4_m);
-		rt->prefix_len = host_route ? 32 : -1;
-		rt->prefix_len = (rt->prefix_len < 0 && default_route) ? 0 : -1;
-		if (rt->prefix_len < 0)
+		pr_debug("%s: Read ip4 mask: %08x\n", __func__, ip4_m);
+		if (host_route)
+			rt->prefix_len = 32;
+		else if (default_route)
+			rt->prefix_len = 0;
+		else
 			rt->prefix_len = inet_mask_len(ip4_m);
 		break;
 	case 2: /* IPv6 Unicast route */
@@ -1098,11 +1100,14 @@ static void rtl930x_route_read(int idx, struct rtl83xx_route *rt)
 		ipv6_addr_set(&ip6_m,
 			      sw_r32(rtl_table_data(r, 6)), sw_r32(rtl_table_data(r, 7)),
 			      sw_r32(rtl_table_data(r, 8)), sw_r32(rtl_table_data(r, 9)));
-		rt->prefix_len = host_route ? 128 : 0;
-		rt->prefix_len = (rt->prefix_len < 0 && default_route) ? 0 : -1;
-		if (rt->prefix_len < 0)
-			rt->prefix_len = find_last_bit((unsigned long int *)&ip6_m.s6_addr32,
-							 128);
+		/* The mask is contiguous, its number of set bits is the prefix length */
+		if (host_route)
+			rt->prefix_len = 128;
+		else if (default_route)
+			rt->prefix_len = 0;
+		else
+			rt->prefix_len = hweight32(ip6_m.s6_addr32[0]) + hweight32(ip6_m.s6_addr32[1]) +
+					 hweight32(ip6_m.s6_addr32[2]) + hweight32(ip6_m.s6_addr32[3]);
 		break;
 	case 1: /* IPv4 Multicast route */
 	case 3: /* IPv6 Multicast route */
@@ -1118,11 +1123,11 @@ static void rtl930x_route_read(int idx, struct rtl83xx_route *rt)
 	rt->attr.dst_null = !!(v & BIT(4));
 	rt->attr.qos_as = !!(v & BIT(3));
 	rt->attr.qos_prio =  v & 0x7;
-	pr_info("%s: index %d is valid: %d\n", __func__, idx, rt->attr.valid);
-	pr_info("%s: next_hop: %d, hit: %d, action :%d, ttl_dec %d, ttl_check %d, dst_null %d\n",
-		__func__, rt->nh.id, rt->attr.hit, rt->attr.action,
-		rt->attr.ttl_dec, rt->attr.ttl_check, rt->attr.dst_null);
-	pr_info("%s: GW: %pI4, prefix_len: %d\n", __func__, &rt->dst_ip, rt->prefix_len);
+	pr_debug("%s: index %d is valid: %d\n", __func__, idx, rt->attr.valid);
+	pr_debug("%s: next_hop: %d, hit: %d, action :%d, ttl_dec %d, ttl_check %d, dst_null %d\n",
+		 __func__, rt->nh.id, rt->attr.hit, rt->attr.action,
+		 rt->attr.ttl_dec, rt->attr.ttl_check, rt->attr.dst_null);
+	pr_debug("%s: GW: %pI4, prefix_len: %d\n", __func__, &rt->dst_ip, rt->prefix_len);
 out:
 	rtl_table_release(r);
 }
@@ -1133,8 +1138,10 @@ static void rtl930x_net6_mask(int prefix_len, struct in6_addr *ip6_m)
 	/* Define network mask */
 	o = prefix_len >> 3;
 	b = prefix_len & 0x7;
+	memset(ip6_m->s6_addr, 0, sizeof(ip6_m->s6_addr));
 	memset(ip6_m->s6_addr, 0xff, o);
-	ip6_m->s6_addr[o] |= b ? 0xff00 >> b : 0x00;
+	if (b)
+		ip6_m->s6_addr[o] = 0xff00 >> b;
 }
 
 /* Read a host route entry from the table using its index
@@ -1162,8 +1169,8 @@ static void rtl930x_host_route_read(int idx, struct rtl83xx_route *rt)
 		break;
 	case 2: /* IPv6 Unicast route */
 		ipv6_addr_set(&rt->dst_ip6,
-			      sw_r32(rtl_table_data(r, 3)), sw_r32(rtl_table_data(r, 2)),
-			      sw_r32(rtl_table_data(r, 1)), sw_r32(rtl_table_data(r, 0)));
+			      sw_r32(rtl_table_data(r, 1)), sw_r32(rtl_table_data(r, 2)),
+			      sw_r32(rtl_table_data(r, 3)), sw_r32(rtl_table_data(r, 4)));
 		break;
 	case 1: /* IPv4 Multicast route */
 	case 3: /* IPv6 Multicast route */
@@ -1207,7 +1214,7 @@ static void rtl930x_host_route_write(int idx, struct rtl83xx_route *rt)
 		rt->attr.dst_null);
 	pr_debug("%s: GW: %pI4, prefix_len: %d\n", __func__, &rt->dst_ip, rt->prefix_len);
 
-	v = BIT(31); /* Entry is valid */
+	v = rt->attr.valid ? BIT(31) : 0;
 	v |= (rt->attr.type & 0x3) << 29;
 	v |= rt->attr.hit ? BIT(20) : 0;
 	v |= rt->attr.dst_null ? BIT(19) : 0;
@@ -1255,11 +1262,11 @@ static int rtl930x_route_lookup_hw(struct rtl83xx_route *rt)
 	if (rt->attr.type == 1 || rt->attr.type == 3) /* Hardware only supports UC routes */
 		return -1;
 
-	sw_w32_mask(0x3 << 19, rt->attr.type, RTL930X_L3_HW_LU_KEY_CTRL);
+	sw_w32_mask(0x3 << 19, rt->attr.type << 19, RTL930X_L3_HW_LU_KEY_CTRL);
 	if (rt->attr.type) { /* IPv6 */
 		rtl930x_net6_mask(rt->prefix_len, &ip6_m);
 		for (int i = 0; i < 4; i++)
-			sw_w32(rt->dst_ip6.s6_addr32[0] & ip6_m.s6_addr32[0],
+			sw_w32(rt->dst_ip6.s6_addr32[i] & ip6_m.s6_addr32[i],
 			       RTL930X_L3_HW_LU_KEY_IP_CTRL + (i << 2));
 	} else { /* IPv4 */
 		ip4_m = inet_make_mask(rt->prefix_len);
@@ -1288,6 +1295,37 @@ static int rtl930x_route_lookup_hw(struct rtl83xx_route *rt)
 	return -1;
 }
 
+/* Test whether the width slots of the host route table starting at idx are all unused */
+static bool rtl930x_l3_slots_free(int idx, int width)
+{
+	struct rtl83xx_route route_entry;
+
+	for (int i = 0; i < width; i++) {
+		memset(&route_entry, 0, sizeof(route_entry));
+		rtl930x_host_route_read(idx + i, &route_entry);
+		if (route_entry.attr.valid)
+			return false;
+	}
+
+	return true;
+}
+
+/* IPv6 entries start at slot 0 or 3 of a bucket, test whether slot s at idx is
+ * the second or third slot of one of them
+ */
+static bool rtl930x_l3_slot_in_ipv6(int idx, int s)
+{
+	struct rtl83xx_route route_entry;
+
+	if (!(s % 3))
+		return false;
+
+	memset(&route_entry, 0, sizeof(route_entry));
+	rtl930x_host_route_read(idx - s % 3, &route_entry);
+
+	return route_entry.attr.valid && route_entry.attr.type == 2;
+}
+
 static int rtl930x_find_l3_slot(struct rtl83xx_route *rt, bool must_exist)
 {
 	int slot_width, algorithm, addr, idx;
@@ -1295,11 +1333,14 @@ static int rtl930x_find_l3_slot(struct rtl83xx_route *rt, bool must_exist)
 	struct rtl83xx_route route_entry;
 
 	/* IPv6 entries take up 3 slots */
-	slot_width = (rt->attr.type == 0) || (rt->attr.type == 2) ? 1 : 3;
+	slot_width = rt->attr.type == 0 ? 1 : 3;
 
 	for (int t = 0; t < 2; t++) {
 		algorithm = (sw_r32(RTL930X_L3_HOST_TBL_CTRL) >> (2 + t)) & 0x1;
-		hash = rtl930x_l3_hash4(rt->dst_ip, algorithm, false);
+		if (rt->attr.type == 2)
+			hash = rtl930x_l3_hash6(&rt->dst_ip6, algorithm, false);
+		else
+			hash = rtl930x_l3_hash4(rt->dst_ip, algorithm, false);
 
 		pr_debug("%s: table %d, algorithm %d, hash %04x\n", __func__, t, algorithm, hash);
 
@@ -1309,12 +1350,22 @@ static int rtl930x_find_l3_slot(struct rtl83xx_route *rt, bool must_exist)
 			idx = ((addr / 8) * 6) + (addr % 8);
 			pr_debug("%s logical address %d\n", __func__, idx);
 
+			memset(&route_entry, 0, sizeof(route_entry));
 			rtl930x_host_route_read(idx, &route_entry);
 			pr_debug("%s route valid %d, route dest: %pI4, hit %d\n", __func__,
-				rt->attr.valid, &rt->dst_ip, rt->attr.hit);
-			if (!must_exist && rt->attr.valid)
+				route_entry.attr.valid, &route_entry.dst_ip, route_entry.attr.hit);
+			if (!route_entry.attr.valid) {
+				/* Entries must not overlap, IPv6 ones use 3 slots */
+				if (!must_exist && rtl930x_l3_slots_free(idx + 1, slot_width - 1) &&
+				    !rtl930x_l3_slot_in_ipv6(idx, s))
+					return idx;
+				continue;
+			}
+			if (!must_exist || route_entry.attr.type != rt->attr.type)
+				continue;
+			if (rt->attr.type == 2 && ipv6_addr_equal(&route_entry.dst_ip6, &rt->dst_ip6))
 				return idx;
-			if (must_exist && route_entry.dst_ip == rt->dst_ip)
+			if (rt->attr.type == 0 && route_entry.dst_ip == rt->dst_ip)
 				return idx;
 		}
 	}
@@ -2131,7 +2182,7 @@ static void rtl930x_set_l3_router_mac(u32 idx, struct rtl93xx_rt_mac *m)
 	struct table_reg *r = rtl_table_get(RTL9300_TBL_1, 0);
 
 	/* The table has a size of 7 registers, 64 entries */
-	v = BIT(20); /* mac entry valid, port type is 0: individual */
+	v = m->valid ? BIT(20) : 0; /* port type is 0: individual */
 	v |= (m->p_id & 0x3f) << 13;
 	v |= (m->vid & 0xfff); /* Set the interface_id to the vlan id */
 
@@ -2552,6 +2603,7 @@ const struct rtl838x_reg rtl930x_reg = {
 	.packet_cntr_clear = rtl930x_packet_cntr_clear,
 	.route_read = rtl930x_route_read,
 	.route_write = rtl930x_route_write,
+	.host_route_read = rtl930x_host_route_read,
 	.host_route_write = rtl930x_host_route_write,
 	.l3_setup = rtl930x_l3_setup,
 	.set_l3_nexthop = rtl930x_set_l3_nexthop,
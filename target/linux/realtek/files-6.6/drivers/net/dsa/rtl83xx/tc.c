@@ -45,7 +45,7 @@ static int rtl83xx_parse_flow_rule(struct rtl838x_switch_priv *priv,
 				flow->rule.frame_type_l4 = 1;
 			if (match.key->ip_proto == IPPROTO_ICMP || match.key->ip_proto == IPPROTO_ICMPV6)
 				flow->rule.frame_type_l4 = 2;
-			if (match.key->ip_proto == IPPROTO_TCP)
+			if (match.key->ip_proto == IPPROTO_IGMP)
 				flow->rule.frame_type_l4 = 3;
 			if ((match.key->ip_proto == IPPROTO_UDP) || flow->rule.frame_type_l4)
 				flow->rule.frame_type_l4_m = 7;
@@ -373,6 +373,252 @@ static int rtl83xx_setup_tc_block_cb(enum tc_setup_type type, void *type_data,
 
 static LIST_HEAD(rtl83xx_block_cb_list);
 
+/* The flowtable describes the rewrite of the Ethernet header as mangle actions
+ * of 4 bytes each. Full words carry the address bytes as they are in memory.
+ * The word at offset 4 is shared by both addresses: the last two bytes of the
+ * destination are passed as a 16 bit value in its low half, the first two
+ * bytes of the source in its high half. Extract those numerically, so this
+ * works independent of the CPU byte order.
+ */
+static void rtl83xx_ft_mangle_eth(const struct flow_action_entry *act, u8 *eth)
+{
+	u32 val = act->mangle.val;
+	u16 half;
+
+	switch (act->mangle.offset) {
+	case 0:
+	case 8:
+		if (!act->mangle.mask)
+			memcpy(eth + act->mangle.offset, &val, 4);
+		break;
+	case 4:
+		if (act->mangle.mask == 0xffff0000) {
+			half = val & 0xffff;
+			memcpy(eth + 4, &half, 2);
+		} else if (act->mangle.mask == 0x0000ffff) {
+			half = val >> 16;
+			memcpy(eth + 6, &half, 2);
+		}
+		break;
+	}
+}
+
+/* Translate a flowtable entry into a PIE rule matching its 5-tuple, which
+ * routes the packets to the flow's nexthop. The switch can rewrite the MAC
+ * addresses and VLAN of a routed packet but has no NAT engine, so flows that
+ * need their addresses or ports translated stay in software.
+ */
+static int rtl83xx_ft_add_flow(struct rtl838x_switch_priv *priv, struct flow_cls_offload *f,
+			       struct rtl83xx_flow *flow)
+{
+	struct flow_rule *rule = flow_cls_offload_flow_rule(f);
+	const struct flow_action_entry *act;
+	u8 eth[2 * ETH_ALEN] = {};
+	int i, err, port = -1, vlan = 0;
+
+	err = rtl83xx_parse_flow_rule(priv, rule, flow);
+	if (err)
+		return err;
+
+	if (flow->rule.frame_type < 2 || !flow->rule.frame_type_l4_m)
+		return -EOPNOTSUPP;
+
+	flow_action_for_each(i, act, &rule->action) {
+		switch (act->id) {
+		case FLOW_ACTION_MANGLE:
+			if (act->mangle.htype != FLOW_ACT_MANGLE_HDR_TYPE_ETH)
+				return -EOPNOTSUPP;
+			rtl83xx_ft_mangle_eth(act, eth);
+			break;
+
+		case FLOW_ACTION_CSUM:
+			/* Only needed after NAT, which is not offloaded */
+			break;
+
+		case FLOW_ACTION_VLAN_PUSH:
+			if (vlan)
+				return -EOPNOTSUPP;
+			vlan = act->vlan.vid;
+			break;
+
+		case FLOW_ACTION_REDIRECT:
+			port = rtl83xx_port_is_under(act->dev, priv);
+			if (port < 0)
+				return -EOPNOTSUPP;
+			break;
+
+		default:
+			pr_debug("%s: Flow action not supported: %d\n", __func__, act->id);
+			return -EOPNOTSUPP;
+		}
+	}
+
+	if (port < 0 || !is_valid_ether_addr(eth))
+		return -EOPNOTSUPP;
+
+	return rtl83xx_l3_flow_add(priv, flow, ether_addr_to_u64(&eth[ETH_ALEN]),
+				   ether_addr_to_u64(eth), port, vlan);
+}
+
+static int rtl83xx_ft_configure(struct rtl838x_switch_priv *priv, struct flow_cls_offload *f)
+{
+	struct rtl83xx_flow *flow;
+	int err;
+
+	if (rhashtable_lookup_fast(&priv->tc_ht, &f->cookie, tc_ht_params))
+		return -EEXIST;
+
+	flow = kzalloc(sizeof(*flow), GFP_KERNEL);
+	if (!flow)
+		return -ENOMEM;
+
+	flow->cookie = f->cookie;
+	flow->priv = priv;
+	flow->lastused = jiffies;
+
+	err = rtl83xx_ft_add_flow(priv, f, flow);
+	if (err)
+		goto out_free;
+
+	/* The per-flow hit counter keeps the flow alive in the flowtable */
+	flow->rule.packet_cntr = rtl83xx_packet_cntr_alloc(priv);
+	if (flow->rule.packet_cntr >= 0) {
+		flow->rule.log_sel = true;
+		flow->rule.log_data = flow->rule.packet_cntr;
+		flow->rule.last_packet_cnt = priv->r->packet_cntr_read(flow->rule.packet_cntr);
+	}
+
+	err = priv->r->pie_rule_add(priv, &flow->rule);
+	if (err)
+		goto out_release;
+
+	err = rhashtable_insert_fast(&priv->tc_ht, &flow->node, tc_ht_params);
+	if (err)
+		goto out_rule_rm;
+
+	return 0;
+
+out_rule_rm:
+	priv->r->pie_rule_rm(priv, &flow->rule);
+out_release:
+	if (flow->rule.packet_cntr >= 0)
+		set_bit(flow->rule.packet_cntr, priv->packet_cntr_use_bm);
+	rtl83xx_l3_flow_del(priv, flow);
+out_free:
+	kfree(flow);
+
+	return err;
+}
+
+static int rtl83xx_ft_delete(struct rtl838x_switch_priv *priv, struct flow_cls_offload *f)
+{
+	struct rtl83xx_flow *flow;
+
+	flow = rhashtable_lookup_fast(&priv->tc_ht, &f->cookie, tc_ht_params);
+	if (!flow)
+		return -ENOENT;
+
+	rhashtable_remove_fast(&priv->tc_ht, &flow->node, tc_ht_params);
+
+	priv->r->pie_rule_rm(priv, &flow->rule);
+	if (flow->rule.packet_cntr >= 0)
+		set_bit(flow->rule.packet_cntr, priv->packet_cntr_use_bm);
+	rtl83xx_l3_flow_del(priv, flow);
+
+	kfree_rcu(flow, rcu_head);
+
+	return 0;
+}
+
+static int rtl83xx_ft_stats(struct rtl838x_switch_priv *priv, struct flow_cls_offload *f)
+{
+	struct rtl83xx_flow *flow;
+	u32 total_packets, new_packets = 0;
+
+	flow = rhashtable_lookup_fast(&priv->tc_ht, &f->cookie, tc_ht_params);
+	if (!flow)
+		return -ENOENT;
+
+	if (flow->rule.packet_cntr >= 0) {
+		total_packets = priv->r->packet_cntr_read(flow->rule.packet_cntr);
+		new_packets = total_packets - flow->rule.last_packet_cnt;
+		flow->rule.last_packet_cnt = total_packets;
+	}
+
+	if (new_packets)
+		flow->lastused = jiffies;
+
+	/* There is no octet counter per flow, only packets are reported */
+	flow_stats_update(&f->stats, 0, new_packets, 0, flow->lastused,
+			  FLOW_ACTION_HW_STATS_IMMEDIATE);
+
+	return 0;
+}
+
+static int rtl83xx_setup_ft_block_cb(enum tc_setup_type type, void *type_data,
+				     void *cb_priv)
+{
+	struct rtl838x_switch_priv *priv = cb_priv;
+	struct flow_cls_offload *f = type_data;
+
+	if (type != TC_SETUP_CLSFLOWER)
+		return -EOPNOTSUPP;
+
+	switch (f->command) {
+	case FLOW_CLS_REPLACE:
+		return rtl83xx_ft_configure(priv, f);
+	case FLOW_CLS_DESTROY:
+		return rtl83xx_ft_delete(priv, f);
+	case FLOW_CLS_STATS:
+		return rtl83xx_ft_stats(priv, f);
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static LIST_HEAD(rtl83xx_ft_block_cb_list);
+
+/* All DSA ports of a flowtable bind the same block on the CPU port's netdev */
+static int rtl83xx_setup_ft_block(struct rtl838x_switch_priv *priv, struct flow_block_offload *f)
+{
+	flow_setup_cb_t *cb = rtl83xx_setup_ft_block_cb;
+	struct flow_block_cb *block_cb;
+
+	if (f->binder_type != FLOW_BLOCK_BINDER_TYPE_CLSACT_INGRESS)
+		return -EOPNOTSUPP;
+
+	f->driver_block_list = &rtl83xx_ft_block_cb_list;
+
+	switch (f->command) {
+	case FLOW_BLOCK_BIND:
+		block_cb = flow_block_cb_lookup(f->block, cb, priv);
+		if (block_cb) {
+			flow_block_cb_incref(block_cb);
+			return 0;
+		}
+		block_cb = flow_block_cb_alloc(cb, priv, priv, NULL);
+		if (IS_ERR(block_cb))
+			return PTR_ERR(block_cb);
+
+		flow_block_cb_incref(block_cb);
+		flow_block_cb_add(block_cb, f);
+		list_add_tail(&block_cb->driver_list, &rtl83xx_ft_block_cb_list);
+		return 0;
+	case FLOW_BLOCK_UNBIND:
+		block_cb = flow_block_cb_lookup(f->block, cb, priv);
+		if (!block_cb)
+			return -ENOENT;
+
+		if (!flow_block_cb_decref(block_cb)) {
+			flow_block_cb_remove(block_cb, f);
+			list_del(&block_cb->driver_list);
+		}
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
 int rtl83xx_setup_tc(struct net_device *dev, enum tc_setup_type type, void *type_data)
 {
 	struct rtl838x_switch_priv *priv;
@@ -388,20 +634,22 @@ int rtl83xx_setup_tc(struct net_device *dev, enum tc_setup_type type, void *type
 	}
 	priv = dev->dsa_ptr->ds->priv;
 
+	if (first_time) {
+		first_time = false;
+		err = rhashtable_init(&priv->tc_ht, &tc_ht_params);
+		if (err)
+			pr_err("%s: Could not initialize hash table\n", __func__);
+	}
+
 	switch (type) {
 	case TC_SETUP_BLOCK:
-		if (first_time) {
-			first_time = false;
-			err = rhashtable_init(&priv->tc_ht, &tc_ht_params);
-			if (err)
-				pr_err("%s: Could not initialize hash table\n", __func__);
-		}
-
 		f->unlocked_driver_cb = true;
 		return flow_block_cb_setup_simple(type_data,
 						  &rtl83xx_block_cb_list,
 						  rtl83xx_setup_tc_block_cb,
 						  priv, priv, true);
+	case TC_SETUP_FT:
+		return rtl83xx_setup_ft_block(priv, type_data);
 	default:
 		return -EOPNOTSUPP;
 	}
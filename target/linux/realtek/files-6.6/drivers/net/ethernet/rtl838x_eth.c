@@ -53,6 +53,15 @@ extern struct rtl83xx_soc_info soc_info;
 
 #define RING_BUFFER	1600
 
+/* RX buffers are page fragments that are turned into skbs with build_skb.
+ * The DMA start stays cache line aligned, as the alignment requirements of
+ * the RX DMA are not documented and the ring buffers always were aligned.
+ * The DMA has no known RX shift either, so the IP header is not aligned.
+ */
+#define RX_BUF_OFFSET	NET_SKB_PAD
+#define RX_BUF_SIZE	(SKB_DATA_ALIGN(RX_BUF_OFFSET + RING_BUFFER) + \
+			 SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
+
 struct p_hdr {
 	uint8_t		*buf;
 	uint16_t	reserved;
@@ -79,8 +88,6 @@ struct ring_b {
 	struct	p_hdr	tx_header[TXRINGS][TXRINGLEN];
 	uint32_t	c_rx[MAX_RXRINGS];
 	uint32_t	c_tx[TXRINGS];
-	uint8_t		tx_space[TXRINGS * TXRINGLEN * RING_BUFFER];
-	uint8_t		*rx_space;
 };
 
 struct notify_block {
@@ -178,13 +185,36 @@ struct rtl838x_rx_q {
 	struct napi_struct napi;
 };
 
+struct rtl838x_rx_buf {
+	void *data;
+	dma_addr_t dma;
+};
+
+/* Packets handed to the ASIC, owned by the driver until the TX is done.
+ * Each TX ring has its own lock, priv->lock is only taken for RX.
+ */
+struct rtl838x_tx_q {
+	spinlock_t lock;
+	struct sk_buff *skb[TXRINGLEN];
+	dma_addr_t dma[TXRINGLEN];
+	u16 len[TXRINGLEN];
+	u32 dirty;
+
+	struct u64_stats_sync syncp;
+	u64 packets;
+	u64 bytes;
+};
+
 struct rtl838x_eth_priv {
 	struct net_device *netdev;
 	struct platform_device *pdev;
 	void *membase;
 	spinlock_t lock;
+	spinlock_t tx_kick_lock;
 	struct mii_bus *mii_bus;
 	struct rtl838x_rx_q rx_qs[MAX_RXRINGS];
+	struct rtl838x_rx_buf *rx_bufs;
+	struct rtl838x_tx_q tx_qs[TXRINGS];
 	struct phylink *phylink;
 	struct phylink_config phylink_config;
 	struct phylink_pcs pcs;
@@ -331,6 +361,129 @@ bool rtl931x_decode_tag(struct p_hdr *h, struct dsa_tag *t)
 	return t->l2_offloaded;
 }
 
+static struct rtl838x_rx_buf *rtl838x_rx_buf(struct rtl838x_eth_priv *priv, int r, int i)
+{
+	return &priv->rx_bufs[r * priv->rxringlen + i];
+}
+
+static int rtl838x_rx_buf_alloc(struct rtl838x_eth_priv *priv, struct rtl838x_rx_buf *buf,
+				bool napi)
+{
+	struct device *dev = &priv->pdev->dev;
+	void *data;
+
+	data = napi ? napi_alloc_frag(RX_BUF_SIZE) : netdev_alloc_frag(RX_BUF_SIZE);
+	if (!data)
+		return -ENOMEM;
+
+	buf->dma = dma_map_single(dev, data + RX_BUF_OFFSET, RING_BUFFER, DMA_FROM_DEVICE);
+	if (dma_mapping_error(dev, buf->dma)) {
+		skb_free_frag(data);
+		return -ENOMEM;
+	}
+	buf->data = data;
+
+	return 0;
+}
+
+static void rtl838x_rx_bufs_free(struct rtl838x_eth_priv *priv)
+{
+	for (int i = 0; i < priv->rxrings * priv->rxringlen; i++) {
+		struct rtl838x_rx_buf *buf = &priv->rx_bufs[i];
+
+		if (!buf->data)
+			continue;
+		dma_unmap_single(&priv->pdev->dev, buf->dma, RING_BUFFER, DMA_FROM_DEVICE);
+		skb_free_frag(buf->data);
+		buf->data = NULL;
+	}
+}
+
+static int rtl838x_rx_bufs_alloc(struct rtl838x_eth_priv *priv)
+{
+	for (int i = 0; i < priv->rxrings * priv->rxringlen; i++) {
+		if (rtl838x_rx_buf_alloc(priv, &priv->rx_bufs[i], false)) {
+			rtl838x_rx_bufs_free(priv);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+/* Reclaim the packets the ASIC is done with, called with the TX queue lock held */
+static void rtl838x_tx_complete(struct rtl838x_eth_priv *priv, int q)
+{
+	struct netdev_queue *txq = netdev_get_tx_queue(priv->netdev, q);
+	struct rtl838x_tx_q *tx_q = &priv->tx_qs[q];
+	struct ring_b *ring = priv->membase;
+	unsigned int bytes = 0, pkts = 0;
+
+	/* A set skb marks a descriptor in flight, which tells a full ring apart
+	 * from an empty one, both have dirty == c_tx
+	 */
+	while (tx_q->skb[tx_q->dirty]) {
+		struct sk_buff *skb = tx_q->skb[tx_q->dirty];
+
+		/* Still owned by the switch */
+		if (ring->tx_r[q][tx_q->dirty] & 0x1)
+			break;
+
+		dma_unmap_single(&priv->pdev->dev, tx_q->dma[tx_q->dirty],
+				 tx_q->len[tx_q->dirty], DMA_TO_DEVICE);
+		bytes += tx_q->len[tx_q->dirty];
+		pkts++;
+		dev_consume_skb_any(skb);
+		tx_q->skb[tx_q->dirty] = NULL;
+		tx_q->dirty = (tx_q->dirty + 1) % TXRINGLEN;
+	}
+
+	if (!pkts)
+		return;
+
+	netdev_tx_completed_queue(txq, pkts, bytes);
+	if (netif_tx_queue_stopped(txq))
+		netif_tx_wake_queue(txq);
+}
+
+/* Drop all packets still queued for TX, the DMA engine must be stopped */
+static void rtl838x_tx_flush(struct rtl838x_eth_priv *priv)
+{
+	struct ring_b *ring = priv->membase;
+
+	for (int q = 0; q < TXRINGS; q++) {
+		struct rtl838x_tx_q *tx_q = &priv->tx_qs[q];
+		unsigned long flags;
+
+		spin_lock_irqsave(&tx_q->lock, flags);
+
+		for (int i = 0; i < TXRINGLEN; i++) {
+			struct sk_buff *skb = tx_q->skb[i];
+
+			ring->tx_r[q][i] &= ~0x1;
+			if (!skb)
+				continue;
+
+			dma_unmap_single(&priv->pdev->dev, tx_q->dma[i], tx_q->len[i], DMA_TO_DEVICE);
+			dev_kfree_skb_any(skb);
+			tx_q->skb[i] = NULL;
+		}
+		ring->c_tx[q] = 0;
+		tx_q->dirty = 0;
+		netdev_tx_reset_queue(netdev_get_tx_queue(priv->netdev, q));
+		spin_unlock_irqrestore(&tx_q->lock, flags);
+	}
+}
+
+static void rtl838x_tx_complete_all(struct rtl838x_eth_priv *priv)
+{
+	for (int q = 0; q < TXRINGS; q++) {
+		spin_lock(&priv->tx_qs[q].lock);
+		rtl838x_tx_complete(priv, q);
+		spin_unlock(&priv->tx_qs[q].lock);
+	}
+}
+
 /* Discard the RX ring-buffers, called as part of the net-ISR
  * when the buffer runs over
  */
@@ -349,9 +502,7 @@ static void rtl838x_rb_cleanup(struct rtl838x_eth_priv *priv, int status)
 			pr_debug("Got something: %d\n", ring->c_rx[r]);
 			h = &ring->rx_header[r][ring->c_rx[r]];
 			memset(h, 0, sizeof(struct p_hdr));
-			h->buf = (u8 *)KSEG1ADDR(ring->rx_space +
-			                         r * priv->rxringlen * RING_BUFFER +
-			                         ring->c_rx[r] * RING_BUFFER);
+			h->buf = (u8 *)KSEG1ADDR(rtl838x_rx_buf(priv, r, ring->c_rx[r])->dma);
 			h->size = RING_BUFFER;
 			/* make sure the header is visible to the ASIC */
 			mb();
@@ -439,10 +590,11 @@ static irqreturn_t rtl83xx_net_irq(int irq, void *dev_id)
 
 	pr_debug("IRQ: %08x\n", status);
 
-	/*  Ignore TX interrupt */
+	/* TX done */
 	if ((status & 0xf0000)) {
 		/* Clear ISR */
 		sw_w32(0x000f0000, priv->r->dma_if_intr_sts);
+		rtl838x_tx_complete_all(priv);
 	}
 
 	/* RX interrupt */
@@ -495,11 +647,12 @@ static irqreturn_t rtl93xx_net_irq(int irq, void *dev_id)
 	pr_debug("In %s, status_tx: %08x, status_rx: %08x, status_rx_r: %08x\n",
 		__func__, status_tx, status_rx, status_rx_r);
 
-	/*  Ignore TX interrupt */
+	/* TX done */
 	if (status_tx) {
 		/* Clear ISR */
 		pr_debug("TX done\n");
 		sw_w32(status_tx, priv->r->dma_if_intr_tx_done_sts);
+		rtl838x_tx_complete_all(priv);
 	}
 
 	/* RX interrupt */
@@ -824,9 +977,7 @@ static void rtl838x_setup_ring_buffer(struct rtl838x_eth_priv *priv, struct ring
 		for (j = 0; j < priv->rxringlen; j++) {
 			h = &ring->rx_header[i][j];
 			memset(h, 0, sizeof(struct p_hdr));
-			h->buf = (u8 *)KSEG1ADDR(ring->rx_space +
-			                         i * priv->rxringlen * RING_BUFFER +
-			                         j * RING_BUFFER);
+			h->buf = (u8 *)KSEG1ADDR(rtl838x_rx_buf(priv, i, j)->dma);
 			h->size = RING_BUFFER;
 			/* All rings owned by switch, last one wraps */
 			ring->rx_r[i][j] = KSEG1ADDR(h) | 1 | (j == (priv->rxringlen - 1) ?
@@ -843,15 +994,13 @@ static void rtl838x_setup_ring_buffer(struct rtl838x_eth_priv *priv, struct ring
 		for (j = 0; j < TXRINGLEN; j++) {
 			h = &ring->tx_header[i][j];
 			memset(h, 0, sizeof(struct p_hdr));
-			h->buf = (u8 *)KSEG1ADDR(ring->tx_space +
-			                         i * TXRINGLEN * RING_BUFFER +
-			                         j * RING_BUFFER);
-			h->size = RING_BUFFER;
 			ring->tx_r[i][j] = KSEG1ADDR(&ring->tx_header[i][j]);
 		}
 		/* Last header is wrapping around */
 		ring->tx_r[i][j - 1] |= WRAP;
 		ring->c_tx[i] = 0;
+		priv->tx_qs[i].dirty = 0;
+		netdev_tx_reset_queue(netdev_get_tx_queue(priv->netdev, i));
 	}
 }
 
@@ -879,10 +1028,15 @@ static int rtl838x_eth_open(struct net_device *ndev)
 	unsigned long flags;
 	struct rtl838x_eth_priv *priv = netdev_priv(ndev);
 	struct ring_b *ring = priv->membase;
+	int err;
 
 	pr_debug("%s called: RX rings %d(length %d), TX rings %d(length %d)\n",
 		__func__, priv->rxrings, priv->rxringlen, TXRINGS, TXRINGLEN);
 
+	err = rtl838x_rx_bufs_alloc(priv);
+	if (err)
+		return err;
+
 	spin_lock_irqsave(&priv->lock, flags);
 	rtl838x_hw_reset(priv);
 	rtl838x_setup_ring_buffer(priv, ring);
@@ -1022,6 +1176,9 @@ static int rtl838x_eth_stop(struct net_device *ndev)
 
 	netif_tx_stop_all_queues(ndev);
 
+	rtl838x_tx_flush(priv);
+	rtl838x_rx_bufs_free(priv);
+
 	return 0;
 }
 
@@ -1112,10 +1269,11 @@ static void rtl838x_eth_tx_timeout(struct net_device *ndev, unsigned int txqueue
 	pr_warn("%s\n", __func__);
 	spin_lock_irqsave(&priv->lock, flags);
 	rtl838x_hw_stop(priv);
+	rtl838x_tx_flush(priv);
 	rtl838x_hw_ring_setup(priv);
 	rtl838x_hw_en_rxtx(priv);
 	netif_trans_update(ndev);
-	netif_start_queue(ndev);
+	netif_tx_wake_all_queues(ndev);
 	spin_unlock_irqrestore(&priv->lock, flags);
 }
 
@@ -1129,11 +1287,15 @@ static int rtl838x_eth_tx(struct sk_buff *skb, struct net_device *dev)
 	struct p_hdr *h;
 	int dest_port = -1;
 	int q = skb_get_queue_mapping(skb) % TXRINGS;
+	struct netdev_queue *txq = netdev_get_tx_queue(dev, q);
+	struct rtl838x_tx_q *tx_q = &priv->tx_qs[q];
+	dma_addr_t dma;
+	u32 next;
 
 	if (q) /* Check for high prio queue */
 		pr_debug("SKB priority: %d\n", skb->priority);
 
-	spin_lock_irqsave(&priv->lock, flags);
+	spin_lock_irqsave(&tx_q->lock, flags);
 	len = skb->len;
 
 	/* Check for DSA tagging at the end of the buffer */
@@ -1150,81 +1312,134 @@ static int rtl838x_eth_tx(struct sk_buff *skb, struct net_device *dev)
 
 	len += 4; /* Add space for CRC */
 
+	/* Zeroes the tail room the ASIC reads beyond skb->len */
 	if (skb_padto(skb, len)) {
 		ret = NETDEV_TX_OK;
 		goto txdone;
 	}
 
 	/* We can send this packet if CPU owns the descriptor */
-	if (!(ring->tx_r[q][ring->c_tx[q]] & 0x1)) {
-
-		/* Set descriptor for tx */
-		h = &ring->tx_header[q][ring->c_tx[q]];
-		h->size = len;
-		h->len = len;
-		/* On RTL8380 SoCs, small packet lengths being sent need adjustments */
-		if (priv->family_id == RTL8380_FAMILY_ID) {
-			if (len < ETH_ZLEN - 4)
-				h->len -= 4;
-		}
+	if (tx_q->skb[ring->c_tx[q]] || (ring->tx_r[q][ring->c_tx[q]] & 0x1)) {
+		dev_warn(&priv->pdev->dev, "Data is owned by switch\n");
+		netif_tx_stop_queue(txq);
+		ret = NETDEV_TX_BUSY;
+		goto txdone;
+	}
 
-		if (dest_port >= 0)
-			priv->r->create_tx_header(h, dest_port, skb->priority >> 1);
+	/* The ASIC reads the packet straight from the skb */
+	dma = dma_map_single(&priv->pdev->dev, skb->data, len, DMA_TO_DEVICE);
+	if (dma_mapping_error(&priv->pdev->dev, dma)) {
+		dev->stats.tx_dropped++;
+		dev_kfree_skb_any(skb);
+		ret = NETDEV_TX_OK;
+		goto txdone;
+	}
 
-		/* Copy packet data to tx buffer */
-		memcpy((void *)KSEG1ADDR(h->buf), skb->data, len);
-		/* Make sure packet data is visible to ASIC */
-		wmb();
+	/* Set descriptor for tx */
+	h = &ring->tx_header[q][ring->c_tx[q]];
+	h->buf = (u8 *)KSEG1ADDR(dma);
+	h->size = len;
+	h->len = len;
+	/* On RTL8380 SoCs, small packet lengths being sent need adjustments */
+	if (priv->family_id == RTL8380_FAMILY_ID) {
+		if (len < ETH_ZLEN - 4)
+			h->len -= 4;
+	}
 
-		/* Hand over to switch */
-		ring->tx_r[q][ring->c_tx[q]] |= 1;
+	if (dest_port >= 0)
+		priv->r->create_tx_header(h, dest_port, skb->priority >> 1);
 
-		/* Before starting TX, prevent a Lextra bus bug on RTL8380 SoCs */
-		if (priv->family_id == RTL8380_FAMILY_ID) {
-			for (int i = 0; i < 10; i++) {
-				u32 val = sw_r32(priv->r->dma_if_ctrl);
-				if ((val & 0xc) == 0xc)
-					break;
-			}
-		}
+	tx_q->skb[ring->c_tx[q]] = skb;
+	tx_q->dma[ring->c_tx[q]] = dma;
+	tx_q->len[ring->c_tx[q]] = len;
+	netdev_tx_sent_queue(txq, len);
 
-		/* Tell switch to send data */
-		if (priv->family_id == RTL9310_FAMILY_ID || priv->family_id == RTL9300_FAMILY_ID) {
-			/* Ring ID q == 0: Low priority, Ring ID = 1: High prio queue */
-			if (!q)
-				sw_w32_mask(0, BIT(2), priv->r->dma_if_ctrl);
-			else
-				sw_w32_mask(0, BIT(3), priv->r->dma_if_ctrl);
-		} else {
-			sw_w32_mask(0, TX_DO, priv->r->dma_if_ctrl);
+	/* Make sure the descriptor is visible to ASIC */
+	wmb();
+
+	/* Hand over to switch */
+	ring->tx_r[q][ring->c_tx[q]] |= 1;
+
+	/* The TX rings share the DMA control register */
+	spin_lock(&priv->tx_kick_lock);
+
+	/* Before starting TX, prevent a Lextra bus bug on RTL8380 SoCs */
+	if (priv->family_id == RTL8380_FAMILY_ID) {
+		for (int i = 0; i < 10; i++) {
+			u32 val = sw_r32(priv->r->dma_if_ctrl);
+			if ((val & 0xc) == 0xc)
+				break;
 		}
+	}
 
-		dev->stats.tx_packets++;
-		dev->stats.tx_bytes += len;
-		dev_kfree_skb(skb);
-		ring->c_tx[q] = (ring->c_tx[q] + 1) % TXRINGLEN;
-		ret = NETDEV_TX_OK;
+	/* Tell switch to send data */
+	if (priv->family_id == RTL9310_FAMILY_ID || priv->family_id == RTL9300_FAMILY_ID) {
+		/* Ring ID q == 0: Low priority, Ring ID = 1: High prio queue */
+		if (!q)
+			sw_w32_mask(0, BIT(2), priv->r->dma_if_ctrl);
+		else
+			sw_w32_mask(0, BIT(3), priv->r->dma_if_ctrl);
 	} else {
-		dev_warn(&priv->pdev->dev, "Data is owned by switch\n");
-		ret = NETDEV_TX_BUSY;
+		sw_w32_mask(0, TX_DO, priv->r->dma_if_ctrl);
+	}
+
+	spin_unlock(&priv->tx_kick_lock);
+
+	u64_stats_update_begin(&tx_q->syncp);
+	tx_q->packets++;
+	tx_q->bytes += len;
+	u64_stats_update_end(&tx_q->syncp);
+	ring->c_tx[q] = (ring->c_tx[q] + 1) % TXRINGLEN;
+
+	/* Stop the queue while the next descriptor is still in use */
+	next = ring->c_tx[q];
+	if (tx_q->skb[next]) {
+		rtl838x_tx_complete(priv, q);
+		if (tx_q->skb[next])
+			netif_tx_stop_queue(txq);
 	}
+	ret = NETDEV_TX_OK;
 
 txdone:
-	spin_unlock_irqrestore(&priv->lock, flags);
+	spin_unlock_irqrestore(&tx_q->lock, flags);
 
 	return ret;
 }
 
-/* Return queue number for TX. On the RTL83XX, these queues have equal priority
- * so we do round-robin
+static void rtl838x_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *stats)
+{
+	struct rtl838x_eth_priv *priv = netdev_priv(dev);
+
+	netdev_stats_to_stats64(stats, &dev->stats);
+
+	/* TX is counted per queue to keep the queues independent */
+	for (int q = 0; q < TXRINGS; q++) {
+		struct rtl838x_tx_q *tx_q = &priv->tx_qs[q];
+		unsigned int start;
+		u64 packets, bytes;
+
+		do {
+			start = u64_stats_fetch_begin(&tx_q->syncp);
+			packets = tx_q->packets;
+			bytes = tx_q->bytes;
+		} while (u64_stats_fetch_retry(&tx_q->syncp, start));
+
+		stats->tx_packets += packets;
+		stats->tx_bytes += bytes;
+	}
+}
+
+/* Return queue number for TX. On the RTL83XX, these queues have equal priority,
+ * control traffic still gets its own queue so it does not wait behind bulk
+ * traffic in the qdisc and the ring.
  */
 u16 rtl83xx_pick_tx_queue(struct net_device *dev, struct sk_buff *skb,
 			  struct net_device *sb_dev)
 {
-	static u8 last = 0;
+	if (skb->priority >= TC_PRIO_CONTROL)
+		return 1;
 
-	last++;
-	return last % TXRINGS;
+	return 0;
 }
 
 /* Return queue number for TX. On the RTL93XX, queue 1 is the high priority queue
@@ -1253,11 +1468,10 @@ static int rtl838x_hw_receive(struct net_device *dev, int r, int budget)
 	last = (u32 *)KSEG1ADDR(sw_r32(priv->r->dma_if_rx_cur + r * 4));
 
 	do {
+		struct rtl838x_rx_buf *buf, new_buf;
 		struct sk_buff *skb;
 		struct dsa_tag tag;
 		struct p_hdr *h;
-		u8 *skb_data;
-		u8 *data;
 		int len;
 
 		if ((ring->rx_r[r][ring->c_rx[r]] & 0x1)) {
@@ -1269,7 +1483,7 @@ static int rtl838x_hw_receive(struct net_device *dev, int r, int budget)
 		}
 
 		h = &ring->rx_header[r][ring->c_rx[r]];
-		data = (u8 *)KSEG1ADDR(h->buf);
+		buf = rtl838x_rx_buf(priv, r, ring->c_rx[r]);
 		len = h->len;
 		if (!len)
 			break;
@@ -1280,8 +1494,17 @@ static int rtl838x_hw_receive(struct net_device *dev, int r, int budget)
 		if (dsa)
 			len += 4;
 
-		skb = netdev_alloc_skb(dev, len + 4);
-		skb_reserve(skb, NET_IP_ALIGN);
+		/* Swap in a fresh buffer, the received one goes up the stack */
+		skb = NULL;
+		if (likely(!rtl838x_rx_buf_alloc(priv, &new_buf, true))) {
+			dma_sync_single_for_cpu(&priv->pdev->dev, buf->dma, len, DMA_FROM_DEVICE);
+			dma_unmap_single_attrs(&priv->pdev->dev, buf->dma, RING_BUFFER,
+					       DMA_FROM_DEVICE, DMA_ATTR_SKIP_CPU_SYNC);
+			skb = napi_build_skb(buf->data, RX_BUF_SIZE);
+			if (!skb)
+				skb_free_frag(buf->data);
+			*buf = new_buf;
+		}
 
 		if (likely(skb)) {
 			/* BUG: Prevent bug on RTL838x SoCs */
@@ -1296,10 +1519,8 @@ static int rtl838x_hw_receive(struct net_device *dev, int r, int budget)
 				}
 			}
 
-			skb_data = skb_put(skb, len);
-			/* Make sure data is visible */
-			mb();
-			memcpy(skb->data, (u8 *)KSEG1ADDR(data), len);
+			skb_reserve(skb, RX_BUF_OFFSET);
+			skb_put(skb, len);
 			/* Overwrite CRC with cpu_tag */
 			if (dsa) {
 				priv->r->decode_tag(h, &tag);
@@ -1334,7 +1555,7 @@ static int rtl838x_hw_receive(struct net_device *dev, int r, int budget)
 
 		/* Reset header structure */
 		memset(h, 0, sizeof(struct p_hdr));
-		h->buf = data;
+		h->buf = (u8 *)KSEG1ADDR(buf->dma);
 		h->size = RING_BUFFER;
 
 		ring->rx_r[r][ring->c_rx[r]] = KSEG1ADDR(h) | 0x1 | (ring->c_rx[r] == (priv->rxringlen - 1) ?
@@ -2393,6 +2614,7 @@ static const struct net_device_ops rtl838x_eth_netdev_ops = {
 	.ndo_open = rtl838x_eth_open,
 	.ndo_stop = rtl838x_eth_stop,
 	.ndo_start_xmit = rtl838x_eth_tx,
+	.ndo_get_stats64 = rtl838x_get_stats64,
 	.ndo_select_queue = rtl83xx_pick_tx_queue,
 	.ndo_set_mac_address = rtl838x_set_mac_address,
 	.ndo_validate_addr = eth_validate_addr,
@@ -2407,6 +2629,7 @@ static const struct net_device_ops rtl839x_eth_netdev_ops = {
 	.ndo_open = rtl838x_eth_open,
 	.ndo_stop = rtl838x_eth_stop,
 	.ndo_start_xmit = rtl838x_eth_tx,
+	.ndo_get_stats64 = rtl838x_get_stats64,
 	.ndo_select_queue = rtl83xx_pick_tx_queue,
 	.ndo_set_mac_address = rtl838x_set_mac_address,
 	.ndo_validate_addr = eth_validate_addr,
@@ -2421,6 +2644,7 @@ static const struct net_device_ops rtl930x_eth_netdev_ops = {
 	.ndo_open = rtl838x_eth_open,
 	.ndo_stop = rtl838x_eth_stop,
 	.ndo_start_xmit = rtl838x_eth_tx,
+	.ndo_get_stats64 = rtl838x_get_stats64,
 	.ndo_select_queue = rtl93xx_pick_tx_queue,
 	.ndo_set_mac_address = rtl838x_set_mac_address,
 	.ndo_validate_addr = eth_validate_addr,
@@ -2435,6 +2659,7 @@ static const struct net_device_ops rtl931x_eth_netdev_ops = {
 	.ndo_open = rtl838x_eth_open,
 	.ndo_stop = rtl838x_eth_stop,
 	.ndo_start_xmit = rtl838x_eth_tx,
+	.ndo_get_stats64 = rtl838x_get_stats64,
 	.ndo_select_queue = rtl93xx_pick_tx_queue,
 	.ndo_set_mac_address = rtl838x_set_mac_address,
 	.ndo_validate_addr = eth_validate_addr,
@@ -2473,7 +2698,6 @@ static int __init rtl838x_eth_probe(struct platform_device *pdev)
 	struct phylink *phylink;
 	u8 mac_addr[ETH_ALEN];
 	int err = 0, rxrings, rxringlen;
-	struct ring_b *ring;
 
 	pr_info("Probing RTL838X eth device pdev: %x, dev: %x\n",
 		(u32)pdev, (u32)(&(pdev->dev)));
@@ -2516,8 +2740,8 @@ static int __init rtl838x_eth_probe(struct platform_device *pdev)
 		goto err_free;
 	}
 
-	/* Allocate buffer memory */
-	priv->membase = dmam_alloc_coherent(&pdev->dev, rxrings * rxringlen * RING_BUFFER +
+	/* Allocate ring memory, packet buffers are mapped on demand */
+	priv->membase = dmam_alloc_coherent(&pdev->dev,
 	                                    sizeof(struct ring_b) + sizeof(struct notify_b),
 	                                    (void *)&dev->mem_start, GFP_KERNEL);
 	if (!priv->membase) {
@@ -2526,11 +2750,19 @@ static int __init rtl838x_eth_probe(struct platform_device *pdev)
 		goto err_free;
 	}
 
-	/* Allocate ring-buffer space at the end of the allocated memory */
-	ring = priv->membase;
-	ring->rx_space = priv->membase + sizeof(struct ring_b) + sizeof(struct notify_b);
+	priv->rx_bufs = devm_kcalloc(&pdev->dev, rxrings * rxringlen, sizeof(*priv->rx_bufs),
+				     GFP_KERNEL);
+	if (!priv->rx_bufs) {
+		err = -ENOMEM;
+		goto err_free;
+	}
 
 	spin_lock_init(&priv->lock);
+	spin_lock_init(&priv->tx_kick_lock);
+	for (int i = 0; i < TXRINGS; i++) {
+		spin_lock_init(&priv->tx_qs[i].lock);
+		u64_stats_init(&priv->tx_qs[i].syncp);
+	}
 
 	dev->ethtool_ops = &rtl838x_ethtool_ops;
 	dev->min_mtu = ETH_ZLEN;